@@ -0,0 +1,124 @@
+// Measures what the AI players' search costs.
+//
+//   ai_bench [--width N] [--height N] [--players N] [--fuse N]
+//            [--budget-ms N] [--decisions N] [--seed N]
+//
+// Reports the cost of a full GameState copy against copyDynamicState()
+// (what a playout starts with), playouts per second of AiPlanner, and how
+// often a planned bot outlives a random one in short matches.
+
+#include "../engine/engine.hpp"
+#include "../engine/ai.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace bombarena;
+
+static double secondsSince(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char **argv) {
+    int width = 11, height = 11, players = 4, fuse = 10;
+    long budgetMs = 20, decisions = 50;
+    unsigned seed = 1;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string a = argv[i];
+        long v = std::stol(argv[i + 1]);
+        if      (a == "--width")     width     = (int)v;
+        else if (a == "--height")    height    = (int)v;
+        else if (a == "--players")   players   = (int)v;
+        else if (a == "--fuse")      fuse      = (int)v;
+        else if (a == "--budget-ms") budgetMs  = v;
+        else if (a == "--decisions") decisions = v;
+        else if (a == "--seed")      seed      = (unsigned)v;
+        else {
+            std::cerr << "unknown option " << a << "\n";
+            return 1;
+        }
+    }
+
+    GameState root = initArena(width, height, players);
+    root.bombFuse = fuse;
+    std::mt19937 rng(seed);
+
+    // A few random turns so the state has bombs in play; player 1 (the
+    // one searched for) must survive them
+    const int me = root.players[0].id;
+    std::vector<PlayerAction> acts;
+    for (int t = 0; t < fuse; t++) {
+        acts.clear();
+        for (auto &p : root.players)
+            acts.push_back({p.id, (ActionType)(rng() % 6)});
+        GameState probe = root;
+        if (step(probe, acts).type == GameResultType::Ongoing && findPlayer(probe, me)->alive)
+            root = probe;
+    }
+
+    // ---- clone cost ----
+    const long copies = 200000;
+    GameState dst;
+    auto t0 = std::chrono::steady_clock::now();
+    for (long i = 0; i < copies; i++) {
+        dst = root;
+        dst.turnNumber += (int)(i & 1);   // keep the copy observable
+    }
+    double full = secondsSince(t0);
+
+    dst = root;
+    t0 = std::chrono::steady_clock::now();
+    for (long i = 0; i < copies; i++) {
+        copyDynamicState(dst, root);
+        dst.turnNumber += (int)(i & 1);
+    }
+    double dyn = secondsSince(t0);
+
+    std::printf("arena %dx%d, %zu players, fuse %d, %zu bombs in play\n",
+                width, height, root.players.size(), fuse, root.bombs.size());
+    std::printf("  full copy          %.0f ns\n", full * 1e9 / copies);
+    std::printf("  copyDynamicState   %.0f ns\n", dyn * 1e9 / copies);
+
+    // ---- playouts ----
+    AiPlanner ai(seed);
+    t0 = std::chrono::steady_clock::now();
+    for (long d = 0; d < decisions; d++)
+        ai.choose(root, me, budgetMs * 1000000);
+    double sec = secondsSince(t0);
+    std::printf("  playouts           %.0f /s (%d turns each), %.0f per %ld ms decision\n",
+                ai.totalRollouts() / sec, fuse + 2,
+                (double)ai.totalRollouts() / decisions, budgetMs);
+
+    // ---- strength: planned player 1 vs random others ----
+    const int games = 20;
+    int survived = 0, randomSurvived = 0, randomSeats = 0;
+    AiPlanner quick(seed + 1);
+    for (int g = 0; g < games; g++) {
+        GameState st = initArena(width, height, players);
+        st.bombFuse = fuse;
+        GameResult r;
+        for (int t = 0; t < 4 * fuse && r.type == GameResultType::Ongoing; t++) {
+            acts.clear();
+            for (auto &p : st.players) {
+                if (!p.alive) continue;
+                ActionType a = p.id == me ? quick.choose(st, me, 2000000, 300)
+                                          : (rng() % 10 == 0 ? ActionType::PlaceBomb
+                                                             : (ActionType)(1 + rng() % 4));
+                acts.push_back({p.id, a});
+            }
+            r = step(st, acts);
+        }
+        for (auto &p : st.players) {
+            if (p.id == me) survived += p.alive;
+            else { randomSurvived += p.alive; randomSeats++; }
+        }
+    }
+    std::printf("  survival over %d turns: planner %d/%d, random %d/%d\n",
+                4 * fuse, survived, games, randomSurvived, randomSeats);
+    return 0;
+}
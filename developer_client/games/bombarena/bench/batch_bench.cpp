@@ -0,0 +1,154 @@
+// Checks stepBatch() against step() and compares their throughput on many
+// independent matches, single-threaded.
+//
+//   batch_bench [--matches N] [--width N] [--height N] [--players N]
+//               [--ticks N] [--seed N]
+//
+// Every match gets the same random inputs in both runs; states are
+// compared every tick. A match that ends is restarted so the run keeps
+// measuring live matches. Reported as match-ticks per second (one match
+// advanced one turn) on this core.
+
+#include "../engine/engine.hpp"
+#include "../engine/batch.hpp"
+#include "../engine/replay.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace bombarena;
+
+static ActionType randomAction(std::mt19937 &rng) {
+    int r = std::uniform_int_distribution<int>(0, 99)(rng);
+    if (r < 15) return ActionType::MoveUp;
+    if (r < 30) return ActionType::MoveDown;
+    if (r < 45) return ActionType::MoveLeft;
+    if (r < 60) return ActionType::MoveRight;
+    if (r < 63) return ActionType::PlaceBomb;
+    return ActionType::Stay;
+}
+
+static bool sameState(const GameState &a, GameState b) {
+    if (stateChecksum(a) != stateChecksum(b)) return false;
+    std::vector<std::pair<int,int>> ea = a.lastExplosionCells;
+    std::sort(ea.begin(), ea.end(), [](auto &l, auto &r) {
+        return l.second != r.second ? l.second < r.second : l.first < r.first;
+    });
+    return ea == b.lastExplosionCells;
+}
+
+int main(int argc, char **argv) {
+    int matches = 1024, width = 11, height = 11, players = 4;
+    long ticks = 2000;
+    unsigned seed = 1;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string a = argv[i];
+        long v = std::stol(argv[i + 1]);
+        if      (a == "--matches") matches = (int)v;
+        else if (a == "--width")   width   = (int)v;
+        else if (a == "--height")  height  = (int)v;
+        else if (a == "--players") players = (int)v;
+        else if (a == "--ticks")   ticks   = v;
+        else if (a == "--seed")    seed    = (unsigned)v;
+        else {
+            std::cerr << "unknown option " << a << "\n";
+            return 1;
+        }
+    }
+
+    const GameState proto = initArena(width, height, players);
+    const int P = (int)proto.players.size();
+
+    // Inputs for every tick up front so both timed loops do the same work
+    std::mt19937 rng(seed);
+    std::vector<ActionType> inputs((size_t)ticks * matches * P);
+    for (auto &a : inputs) a = randomAction(rng);
+
+    // ---- correctness ----
+    {
+        const long checkTicks = std::min(ticks, 500L);
+        const int checkMatches = std::min(matches, 64);
+        std::vector<GameState> ref(checkMatches, proto);
+        MatchBatch batch;
+        batch.init(proto, checkMatches);
+        std::vector<PlayerAction> acts;
+        std::vector<ActionType> batchActs((size_t)checkMatches * P);
+        std::vector<GameResult> refRes(checkMatches);
+
+        for (long t = 0; t < checkTicks; t++) {
+            for (int m = 0; m < checkMatches; m++) {
+                acts.clear();
+                for (int p = 0; p < P; p++) {
+                    ActionType a = inputs[((size_t)t * matches + m) * P + p];
+                    acts.push_back({proto.players[p].id, a});
+                    batchActs[(size_t)m * P + p] = a;
+                }
+                refRes[m] = step(ref[m], acts);
+            }
+            stepBatch(batch, batchActs.data());
+
+            for (int m = 0; m < checkMatches; m++) {
+                if (!sameState(ref[m], batch.extract(m)) ||
+                    refRes[m].type != batch.result[m].type ||
+                    refRes[m].winnerId != batch.result[m].winnerId) {
+                    std::printf("MISMATCH match %d turn %d\n", m, ref[m].turnNumber);
+                    return 1;
+                }
+                if (batch.result[m].type != GameResultType::Ongoing) {
+                    ref[m] = proto;
+                    batch.load(m, proto);
+                }
+            }
+        }
+        std::printf("stepBatch == step: OK (%d matches x %ld ticks)\n", checkMatches, checkTicks);
+    }
+
+    // ---- throughput ----
+    long restarts = 0;
+    std::vector<GameState> states(matches, proto);
+    std::vector<PlayerAction> acts;
+    acts.reserve(P);
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (long t = 0; t < ticks; t++) {
+        const ActionType *in = &inputs[(size_t)t * matches * P];
+        for (int m = 0; m < matches; m++) {
+            acts.clear();
+            for (int p = 0; p < P; p++) acts.push_back({proto.players[p].id, in[(size_t)m * P + p]});
+            if (step(states[m], acts).type != GameResultType::Ongoing) {
+                states[m] = proto;
+                restarts++;
+            }
+        }
+    }
+    double stepSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    MatchBatch batch;
+    batch.init(proto, matches);
+    long batchRestarts = 0;
+
+    t0 = std::chrono::steady_clock::now();
+    for (long t = 0; t < ticks; t++) {
+        stepBatch(batch, &inputs[(size_t)t * matches * P]);
+        for (int m = 0; m < matches; m++)
+            if (batch.result[m].type != GameResultType::Ongoing) {
+                batch.load(m, proto);
+                batchRestarts++;
+            }
+    }
+    double batchSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    const double mt = (double)ticks * matches;
+    std::printf("%d matches, arena %dx%d, %d players, %ld ticks (%ld / %ld restarts)\n",
+                matches, width, height, P, ticks, restarts, batchRestarts);
+    std::printf("  step()       %.2f M match-ticks/s\n", mt / stepSec / 1e6);
+    std::printf("  stepBatch()  %.2f M match-ticks/s  (x%.2f)\n",
+                mt / batchSec / 1e6, stepSec / batchSec);
+    return 0;
+}
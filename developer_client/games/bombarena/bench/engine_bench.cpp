@@ -0,0 +1,81 @@
+// Steps a large arena with random inputs and reports tick throughput.
+//
+//   engine_bench [--width N] [--height N] [--players N] [--ticks N] [--seed N]
+//
+// A finished game (win / draw) is replaced by a fresh arena so the run
+// always measures full-size states.
+
+#include "../engine/engine.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace bombarena;
+
+int main(int argc, char **argv) {
+    int width = 101, height = 101, players = 64;
+    long ticks = 20000;
+    unsigned seed = 1;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string a = argv[i];
+        long v = std::stol(argv[i + 1]);
+        if      (a == "--width")   width   = (int)v;
+        else if (a == "--height")  height  = (int)v;
+        else if (a == "--players") players = (int)v;
+        else if (a == "--ticks")   ticks   = v;
+        else if (a == "--seed")    seed    = (unsigned)v;
+        else {
+            std::cerr << "unknown option " << a << "\n";
+            return 1;
+        }
+    }
+
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> roll(0, 99);
+
+    GameState st = initArena(width, height, players);
+    std::vector<PlayerAction> acts;
+    acts.reserve(players);
+
+    long games = 1;
+    long aliveSum = 0, bombSum = 0;
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (long t = 0; t < ticks; ++t) {
+        acts.clear();
+        for (auto &p : st.players) {
+            if (!p.alive) continue;
+            int r = roll(rng);
+            ActionType a = ActionType::Stay;
+            if      (r < 15) a = ActionType::MoveUp;
+            else if (r < 30) a = ActionType::MoveDown;
+            else if (r < 45) a = ActionType::MoveLeft;
+            else if (r < 60) a = ActionType::MoveRight;
+            else if (r < 63) a = ActionType::PlaceBomb;
+            acts.push_back({p.id, a});
+        }
+
+        GameResult res = step(st, acts);
+        aliveSum += (long)acts.size();
+        bombSum  += (long)st.bombs.size();
+
+        if (res.type != GameResultType::Ongoing) {
+            st = initArena(width, height, players);
+            games++;
+        }
+    }
+    auto t1 = std::chrono::steady_clock::now();
+
+    double sec = std::chrono::duration<double>(t1 - t0).count();
+    std::printf("arena %dx%d, %d players, %ld ticks, %ld games\n",
+                width, height, players, ticks, games);
+    std::printf("  %.0f ticks/s, %.2f us/tick\n", ticks / sec, sec * 1e6 / ticks);
+    std::printf("  avg alive %.1f, avg bombs %.1f\n",
+                (double)aliveSum / ticks, (double)bombSum / ticks);
+    return 0;
+}
@@ -0,0 +1,181 @@
+// Runs a real BombArenaServer (built with BOMBARENA_ALLOC_CHECK) against
+// bots on loopback and counts the heap allocations its tick thread makes
+// once the match has warmed up: input draining, step(), the replay log,
+// snapshot capture, area-of-interest views, STATE_UPDATE encoding into the
+// pooled buffers, the send queues, the AI hand-off and the once-a-second
+// stats hand-off (the server logs its stats every 2 s in this build, so
+// the default window spans a couple of log lines). Exits non-zero if any
+// steady-state tick allocates.
+//
+//   tick_alloc_check [--port N] [--tick-rate N] [--width N] [--height N]
+//                    [--players N] [--ai N] [--aoi N] [--ticks N] [--seed N]
+//
+// --players bots connect over TCP, acknowledge every snapshot and send a
+// move with each; --ai AI players fill the room. Bots never bomb, so the
+// match runs long enough. Other threads allocate as they like: only the
+// tick thread's allocations are counted.
+
+#include "../server/game_server.hpp"
+#include "../engine/snapshot.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace bombarena;
+
+static thread_local size_t t_allocs = 0;
+
+size_t threadAllocCount() { return t_allocs; }
+
+// GCC pairs the inlined replacement new with the library delete it can
+// see in the server's headers and warns; both end in malloc/free
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void *operator new(size_t n) {
+    t_allocs++;
+    if (void *p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+void *operator new[](size_t n) { return operator new(n); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+
+static std::atomic<int> g_joined{0};
+
+// One player: joins, the first one starts the match once all are in, then
+// acks every snapshot and answers it with a move
+static void botLoop(int port, int bots, unsigned seed) {
+    TCPConnection conn;
+    for (int tries = 0; !conn.connectToServer("127.0.0.1", port); tries++) {
+        if (tries == 50) {
+            std::cerr << "cannot connect to port " << port << "\n";
+            std::_Exit(1);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+
+    std::mt19937 rng(seed);
+    static const char *kMoves[] = {"w", "s", "a", "d"};
+    SnapshotReceiver rx;
+    GameState st;
+    uint32_t seq = 1;
+
+    Packet p;
+    while (conn.recvPacket(p)) {
+        if (p.type == PacketType::JOIN_GAME) {
+            st = arenaFromJoin(p.data);
+            if (g_joined.fetch_add(1) == 0) {
+                while (g_joined < bots)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                Packet s;
+                s.type = PacketType::PLAYER_START_GAME;
+                conn.sendPacket(s);
+            }
+        }
+        else if (p.type == PacketType::STATE_UPDATE) {
+            bool applied = rx.apply(p.data, st);
+            Packet ack;
+            ack.type = PacketType::STATE_ACK;
+            ack.data["turn"] = rx.lastTurn();
+            if (!applied) ack.data["keyframe"] = true;
+            conn.sendPacket(ack);
+
+            Packet a;
+            a.type = PacketType::PLAYER_ACTION;
+            a.data["action"] = kMoves[rng() % 4];
+            a.data["seq"] = seq++;
+            conn.sendPacket(a);
+        }
+        else if (p.type == PacketType::GAME_END) {
+            break;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    ServerOptions opts;
+    opts.port = 17950;
+    opts.tickHz = 200;
+    opts.width = opts.height = 31;
+    opts.aoiRadius = 8;
+    opts.recordPath = "/dev/null";   // the replay log is written all the same
+    int bots = 8, ai = 4;
+    long ticks = 1000;
+    unsigned seed = 1;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string a = argv[i];
+        long v = std::stol(argv[i + 1]);
+        if      (a == "--port")      opts.port   = (int)v;
+        else if (a == "--tick-rate") opts.tickHz = (int)v;
+        else if (a == "--width")     opts.width  = (int)v;
+        else if (a == "--height")    opts.height = (int)v;
+        else if (a == "--players")   bots        = (int)v;
+        else if (a == "--ai")        ai          = (int)v;
+        else if (a == "--aoi")       opts.aoiRadius = (int)v;
+        else if (a == "--ticks")     ticks       = v;
+        else if (a == "--seed")      seed        = (unsigned)v;
+        else {
+            std::cerr << "unknown option " << a << "\n";
+            return 1;
+        }
+    }
+    if (bots < 1 || opts.tickHz < 1) {
+        std::cerr << "need --players >= 1 and --tick-rate >= 1\n";
+        return 1;
+    }
+    opts.maxPlayers = bots + ai;
+    opts.aiFill = bots + ai;
+
+    // The server's own log would drown the result
+    std::cout.setstate(std::ios::failbit);
+
+    BombArenaServer server(opts);
+    std::atomic<bool> over{false};
+    std::thread srv([&] { server.run(); over = true; });
+    std::vector<std::thread> players;
+    for (int b = 0; b < bots; b++)
+        players.emplace_back(botLoop, opts.port, bots, seed + b);
+
+    // The match only ends on its own after its full length; stop as soon
+    // as enough ticks are in
+    const BombArenaServer::AllocStats &s = server.allocStats();
+    while (s.ticks < ticks && !over)
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    long measured = s.ticks;
+    size_t allocs = s.allocs, worst = s.worst;
+    long dirty = s.dirtyTicks;
+
+    std::printf("arena %dx%d, %d bots + %d AI, AOI %d, %d Hz, %ld ticks after %d warm-up turns\n",
+                opts.width, opts.height, bots, ai, opts.aoiRadius, opts.tickHz,
+                measured, 2 * kSnapshotHistory);
+    std::printf("  %zu allocations on the tick thread (%ld ticks allocated, worst %zu)\n",
+                allocs, dirty, worst);
+
+    int rc = 0;
+    if (measured < ticks) {
+        std::printf("FAIL: the match ended after %ld measured ticks; try another --seed\n",
+                    measured);
+        rc = 1;
+    } else if (allocs != 0) {
+        std::printf("FAIL: steady-state ticks must not allocate\n");
+        rc = 1;
+    } else {
+        std::printf("OK\n");
+    }
+    std::fflush(stdout);
+    // The server has no stop call and its threads are still running
+    std::_Exit(rc);
+}
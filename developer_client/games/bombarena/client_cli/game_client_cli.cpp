@@ -8,6 +8,7 @@
 #include "../shared/tcp.hpp"
 #include "../shared/packet.hpp"
 #include "../engine/engine.hpp"
+#include "../engine/snapshot.hpp"
 
 using namespace bombarena;
 
@@ -60,8 +61,10 @@ private:
     std::atomic<bool> running;
     std::atomic<bool> gameStarted;
     int playerId;
+    bool spectating = false;   // joined through a spectator relay
 
     GameState localState;
+    SnapshotReceiver snapshots;
 
     void mainLoop() {
         redrawWaiting();
@@ -115,6 +118,8 @@ private:
             switch (p.type) {
                 case PacketType::JOIN_GAME:
                     playerId = p.data["player_id"];
+                    spectating = p.data.value("spectator", false);
+                    localState = arenaFromJoin(p.data);
                     std::cout << "[CLI] You are Player " << playerId << "\n";
                     redrawWaiting();
                     break;
@@ -124,10 +129,19 @@ private:
                     gameStarted = true;
                     break;
 
-                case PacketType::STATE_UPDATE:
-                    updateLocalState(p.data);
-                    redraw();
+                case PacketType::STATE_UPDATE: {
+                    bool applied = snapshots.apply(p.data, localState);
+
+                    // Lets the server delta against what we have
+                    Packet ack;
+                    ack.type = PacketType::STATE_ACK;
+                    ack.data["turn"] = snapshots.lastTurn();
+                    if (!applied) ack.data["keyframe"] = true;
+                    conn.sendPacket(ack);
+
+                    if (applied) redraw();
                     break;
+                }
 
                 case PacketType::GAME_END:
                     running = false;
@@ -141,43 +155,13 @@ private:
     }
 
 
-    void updateLocalState(const nlohmann::json &d) {
-        localState.turnNumber = d["turn"];
-
-        localState.players.clear();
-        for (auto &p : d["players"]) {
-            PlayerState ps;
-            ps.id    = p["id"];
-            ps.x     = p["x"];
-            ps.y     = p["y"];
-            ps.alive = p["alive"];
-            localState.players.push_back(ps);
-        }
-
-        localState.bombs.clear();
-        for (auto &b : d["bombs"]) {
-            Bomb bb;
-            bb.x     = b["x"];
-            bb.y     = b["y"];
-            bb.timer = b["timer"];
-            if (b.contains("ownerId")) bb.ownerId = b["ownerId"];
-            if (b.contains("range"))   bb.range   = b["range"];
-            localState.bombs.push_back(bb);
-        }
-
-        localState.lastExplosionCells.clear();
-        if (d.contains("explosions")) {
-            for (auto &e : d["explosions"])
-                localState.lastExplosionCells.emplace_back(e["x"], e["y"]);
-        }
-    }
-
-
     void redrawWaiting() {
         system("clear");
         std::cout << "=== BombArena CLI ===\n";
 
-        if (playerId == -1) {
+        if (spectating) {
+            std::cout << "Spectating; waiting for the match to start.\n";
+        } else if (playerId == -1) {
             std::cout << "Waiting for JOIN_GAME...\n";
         } else {
             std::cout << "You are Player " << playerId << "\n";
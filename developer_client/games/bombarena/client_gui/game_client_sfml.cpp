@@ -1,34 +1,93 @@
 #include <SFML/Graphics.hpp>
 #include "../shared/tcp.hpp"
 #include "../shared/packet.hpp"
+#include "../shared/udp.hpp"
 #include "../engine/engine.hpp"
+#include "../engine/snapshot.hpp"
 
 #include <thread>
 #include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <deque>
 #include <iostream>
+#include <mutex>
+#include <unordered_map>
+#include <poll.h>
 
 using namespace bombarena;
 
 class BombArenaClientGUI {
 private:
-    TCPConnection conn;
+    // Replaced when we resume after a drop; senders take their own reference
+    std::mutex connMutex;
+    std::shared_ptr<TCPConnection> conn = std::make_shared<TCPConnection>();
+    std::string serverIp;
+    int serverPort;
+
+    // From JOIN_GAME: a new connection can take our player back with it
+    // within the server's grace window
+    uint64_t session = 0;
+    std::atomic<bool> gameOver{false};
+    static constexpr int kReconnectSeconds = 30;
     std::atomic<bool> running{true};
     std::atomic<bool> gameStarted{false};
 
-    GameState state;
+    std::mutex stateMutex;   // network thread vs. render loop
+    GameState state;         // authoritative, rebuilt from snapshots
+    GameState view;          // state + our inputs the server has not acked
+    SnapshotReceiver snapshots;
     int playerId = -1;
 
+    // Client-side prediction: inputs are applied to `view` as soon as they
+    // are sent and replayed on top of every snapshot until its acks say
+    // the server has applied them
+    struct PendingInput {
+        uint32_t seq;
+        ActionType act;
+    };
+    std::deque<PendingInput> pending;
+    uint32_t nextSeq = 1;
+    int bombFuse = 10;
+
+    // Other players are drawn moving from their previous snapshot position
+    // to the latest one over a tick
+    float tickMs = 200.f;
+    sf::Clock sinceSnapshot;
+    std::unordered_map<int, sf::Vector2f> prevPos;
+
+    // Optional UDP channel offered in JOIN_GAME. Until the server answers
+    // our hello (or if it never does) everything stays on TCP.
+    std::thread udpThread;
+    std::atomic<bool> udpUp{false};
+    int udpSock = -1;
+    std::atomic<uint64_t> udpToken{0};   // changes when we resume
+
     sf::RenderWindow window;
+    sf::Font font;   // loaded once
     const int TILE = 40;
 
+    // Frames are paced by the window: at most maxFps, or the display's
+    // refresh with maxFps 0 (vsync). A frame is drawn only for something
+    // new (dirty), while something moves between snapshots, and once more
+    // to land it; otherwise the loop idles and the last frame stands.
+    int maxFps = 60;
+    std::atomic<bool> dirty{true};
+    static constexpr int kIdleSleepMs = 10;
+    // Board area in tiles; larger maps scroll to keep our player centred
+    const int VIEW_W = 15, VIEW_H = 11;
+
     bool isHost = false;          
     bool sentStartRequest = false;
+    std::string seatToken;   // from the lobby's START_GAME; ties results to our account
 
 public:
-    BombArenaClientGUI(const std::string& ip, int port, int is_host)
-        : window(sf::VideoMode(600, 600), "BombArena GUI")
+    BombArenaClientGUI(const std::string& ip, int port, int is_host,
+                       const std::string &seat = "", int fps = 60)
+        : serverIp(ip), serverPort(port), window(sf::VideoMode(600, 600), "BombArena GUI"),
+          maxFps(fps), seatToken(seat)
     {
-        if (!conn.connectToServer(ip, port)) {
+        if (!conn->connectToServer(ip, port)) {
             std::cout << "[GUI] Cannot connect\n";
             exit(1);
         }
@@ -36,44 +95,87 @@ public:
         std::cout << "[GUI] Connected. Waiting for JOIN_GAME...\n";
         std::cout << "isHost: " << is_host <<"\n";
         isHost = is_host;
+        if (!font.loadFromFile("/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf"))
+            std::cout << "[GUI] Font not found, no text\n";
         state = initTwoPlayerDefault();
         state.players.clear();
         state.bombs.clear();
         state.turnNumber = 0;
+        view = state;
     }
 
     void start() {
         std::thread net(&BombArenaClientGUI::networkThread, this);
         gameLoop();
         net.join();
+        if (udpThread.joinable()) udpThread.join();
+        if (udpSock >= 0) close(udpSock);
     }
 
 private:
+    std::shared_ptr<TCPConnection> link() {
+        std::lock_guard<std::mutex> lk(connMutex);
+        return conn;
+    }
+
     void networkThread() {
         while (running) {
             Packet p;
-            if (!conn.recvPacket(p)) {
+            if (!link()->recvPacket(p)) {
+                if (running && !gameOver && session && reconnect())
+                    continue;
                 running = false;
                 break;
             }
 
             switch (p.type) {
 
-                case PacketType::JOIN_GAME:
+                case PacketType::JOIN_GAME: {
+                    std::lock_guard<std::mutex> lk(stateMutex);
                     playerId = p.data["player_id"];
+                    session  = p.data.value("session", (uint64_t)0);
+                    state    = arenaFromJoin(p.data);
+                    view     = state;
+                    tickMs   = p.data.value("tick_ms", 200.0);
+                    bombFuse = p.data.value("bomb_fuse", 10);
                     std::cout << "[GUI] You are player " << playerId << "\n";
+                    dirty = true;
+                    if (!seatToken.empty()) {
+                        Packet me;
+                        me.type = PacketType::JOIN_GAME;
+                        me.data["seat"] = seatToken;
+                        link()->sendPacket(me);
+                    }
+                    if (p.data.contains("udp_port") && !udpThread.joinable()) {
+                        udpToken  = p.data.value("udp_token", (uint64_t)0);
+                        udpThread = std::thread(&BombArenaClientGUI::udpLoop, this,
+                                                p.data.value("udp_port", 0));
+                    }
                     break;
+                }
 
                 case PacketType::PLAYER_START_GAME:
                     std::cout << "[GUI] START signal received\n";
                     gameStarted = true;
+                    dirty = true;
                     break;
 
-                case PacketType::STATE_UPDATE:
-                    updateState(p.data);
+                case PacketType::STATE_UPDATE: {
+                    int turn;
+                    bool applied = onSnapshot(p.data, turn);
+
+                    // Lets the server delta against what we have
+                    Packet ack;
+                    ack.type = PacketType::STATE_ACK;
+                    ack.data["turn"] = turn;
+                    if (!applied) ack.data["keyframe"] = true;
+                    link()->sendPacket(ack);
                     break;
+                }
 
                 case PacketType::GAME_END:
+                    gameOver = true;
+                    dirty = true;
                     showGameEnd(p.data);
                     break;
 
@@ -83,53 +185,208 @@ private:
         }
     }
 
-    void updateState(const nlohmann::json& d) {
-        state.turnNumber = d["turn"];
+    // RESUME_GAME on a fresh connection, retried until the grace window
+    // is over. The server answers with JOIN_GAME (resumed, and the last
+    // input seq it applied), then START and a keyframe arrive through the
+    // normal loop. Inputs it never got are sent again; it skips repeats
+    // by seq.
+    bool reconnect() {
+        std::cout << "[GUI] Connection lost, reconnecting...\n";
+        udpUp = false;
+        sf::Clock elapsed;
+        while (running && elapsed.getElapsedTime().asSeconds() < kReconnectSeconds) {
+            sf::sleep(sf::milliseconds(1000));
+            auto next = std::make_shared<TCPConnection>();
+            if (!next->connectToServer(serverIp, serverPort)) continue;
+
+            Packet r, j;
+            r.type = PacketType::RESUME_GAME;
+            r.data["session"] = session;
+            if (!next->sendPacket(r) || !next->recvPacket(j)) continue;
+            if (j.type != PacketType::JOIN_GAME) {
+                std::cout << "[GUI] Cannot resume: " << j.data.value("msg", "") << "\n";
+                return false;
+            }
 
-        state.players.clear();
-        for (auto& p : d["players"]) {
-            PlayerState ps;
-            ps.id = p["id"];
-            ps.x = p["x"];
-            ps.y = p["y"];
-            ps.alive = p["alive"];
-            state.players.push_back(ps);
+            std::vector<Packet> resend;
+            {
+                std::lock_guard<std::mutex> lk(stateMutex);
+                const uint32_t acked = j.data.value("acked_seq", 0u);
+                while (!pending.empty() && pending.front().seq <= acked)
+                    pending.pop_front();
+                for (auto &in : pending) {
+                    Packet a;
+                    a.type = PacketType::PLAYER_ACTION;
+                    a.data["action"] = actionKey(in.act);
+                    a.data["seq"] = in.seq;
+                    resend.push_back(a);
+                }
+                repredict();
+            }
+            dirty = true;
+            udpToken = j.data.value("udp_token", (uint64_t)0);
+            {
+                std::lock_guard<std::mutex> lk(connMutex);
+                conn = next;
+            }
+            for (auto &a : resend) next->sendPacket(a);
+            std::cout << "[GUI] Resumed as player " << playerId << "\n";
+            return true;
         }
+        return false;
+    }
 
-        state.bombs.clear();
-        for (auto& b : d["bombs"]) {
-            Bomb bb;
-            bb.x = b["x"];
-            bb.y = b["y"];
-            bb.timer = b["timer"];
-            if (b.contains("ownerId")) bb.ownerId = b["ownerId"];
-            if (b.contains("range"))   bb.range   = b["range"];
-            state.bombs.push_back(bb);
+    static const char *actionKey(ActionType a) {
+        switch (a) {
+            case ActionType::MoveUp:    return "w";
+            case ActionType::MoveDown:  return "s";
+            case ActionType::MoveLeft:  return "a";
+            case ActionType::MoveRight: return "d";
+            case ActionType::PlaceBomb: return "b";
+            default:                    return "";
         }
-        state.lastExplosionCells.clear();
-        if (d.contains("explosions")) {
-            for (auto &e : d["explosions"]) {
-                int ex = e["x"];
-                int ey = e["y"];
-                state.lastExplosionCells.emplace_back(ex, ey);
+    }
+
+    void udpLoop(int port) {
+        udpSock = udpConnect(serverIp, port);
+        if (udpSock < 0) return;
+
+        // The token changes if we resume
+        auto hello = [this] {
+            Packet h;
+            h.type = PacketType::UDP_HELLO;
+            h.data["token"] = udpToken.load();
+            return h.serialize();
+        };
+
+        char buf[65536];
+        int tries = 0;
+        sf::Clock sinceHello;
+        while (running) {
+            if (!udpUp) {
+                if (tries++ == 8) {
+                    std::cout << "[GUI] No UDP reply, staying on TCP\n";
+                    return;
+                }
+                udpSend(udpSock, hello());
+            } else if (sinceHello.getElapsedTime().asMilliseconds() >= 500) {
+                // Keepalive: the server falls back to TCP after a silent spell
+                udpSend(udpSock, hello());
+                sinceHello.restart();
+            }
+
+            pollfd pfd{udpSock, POLLIN, 0};
+            if (poll(&pfd, 1, udpUp ? 200 : 250) <= 0) continue;
+            ssize_t n = recv(udpSock, buf, sizeof(buf), 0);
+            if (n <= 0) continue;
+
+            Packet p;
+            try {
+                p = Packet::deserialize(std::string(buf, (size_t)n));
+            } catch (std::exception &) {
+                continue;
+            }
+
+            if (p.type == PacketType::UDP_HELLO && !udpUp) {
+                udpUp = true;
+                std::cout << "[GUI] UDP channel up\n";
+            } else if (p.type == PacketType::STATE_UPDATE) {
+                // Late or reordered datagrams are dropped by the receiver
+                int turn;
+                bool applied = onSnapshot(p.data, turn);
+
+                Packet ack;
+                ack.type = PacketType::STATE_ACK;
+                ack.data["token"] = udpToken.load();
+                ack.data["turn"] = turn;
+                if (!applied) ack.data["keyframe"] = true;
+                udpSend(udpSock, ack.serialize());
             }
         }
     }
 
+    // Called from the TCP and UDP threads. `ackTurn` gets the turn to
+    // acknowledge, read under the same lock as the apply.
+    bool onSnapshot(const nlohmann::json &d, int &ackTurn) {
+        std::lock_guard<std::mutex> lk(stateMutex);
+
+        // Where everyone was, kept only if this update moves the state on;
+        // a failed or stale one leaves the interpolation alone
+        std::unordered_map<int, sf::Vector2f> prev;
+        for (auto &pl : state.players)
+            prev[pl.id] = sf::Vector2f((float)pl.x, (float)pl.y);
+
+        const int before = snapshots.lastTurn();
+        bool applied = snapshots.apply(d, state);
+        ackTurn = snapshots.lastTurn();
+        if (!applied)
+            return false;
+        if (ackTurn == before)
+            return true;   // stale; nothing changed
+        prevPos.swap(prev);
+        sinceSnapshot.restart();
+        dirty = true;
+
+        uint32_t acked = 0;
+        if (d.contains("acks"))
+            for (auto &a : d["acks"])
+                if (a.value("id", -1) == playerId)
+                    acked = a.value("seq", 0u);
+        while (!pending.empty() && pending.front().seq <= acked)
+            pending.pop_front();
+
+        repredict();
+        return true;
+    }
+
+    // Caller holds stateMutex
+    void repredict() {
+        view = state;
+        view.bombFuse = bombFuse;
+        for (auto &in : pending)
+            applyLocalAction(view, playerId, in.act);
+    }
 
     void gameLoop() {
+        // Not both: SFML's limiter would fight the driver's
+        if (maxFps > 0) window.setFramerateLimit(maxFps);
+        else            window.setVerticalSyncEnabled(true);
+
+        bool landing = false;   // the last frame was mid-movement
         while (window.isOpen() && running) {
             handleInput();   
-            draw();
-            sf::sleep(sf::milliseconds(16));
+            const bool moving = animating();
+            if (!dirty.exchange(false) && !moving && !landing) {
+                sf::sleep(sf::milliseconds(kIdleSleepMs));
+                continue;
+            }
+            landing = moving;
+            draw();   // display() waits out the frame
         }
     }
 
+    // Whether the next frame differs from the last one without new state:
+    // another player is still sliding to its new cell, or a fuse burns
+    bool animating() {
+        if (!gameStarted) return false;
+        std::lock_guard<std::mutex> lk(stateMutex);
+        if (!view.bombs.empty()) return true;
+        if (sinceSnapshot.getElapsedTime().asMilliseconds() >= tickMs) return false;
+        for (auto &p : view.players) {
+            if (p.id == playerId || !p.alive) continue;
+            auto it = prevPos.find(p.id);
+            if (it != prevPos.end() && (it->second.x != p.x || it->second.y != p.y))
+                return true;
+        }
+        return false;
+    }
+
 
     void handleInput() {
 
         sf::Event e;
         while (window.pollEvent(e)) {
+            dirty = true;   // resize, focus, exposure, input
 
             if (e.type == sf::Event::Closed) {
                 window.close();
@@ -141,7 +398,7 @@ private:
                 if (e.type == sf::Event::KeyPressed && e.key.code == sf::Keyboard::G) {
                     Packet p;
                     p.type = PacketType::PLAYER_START_GAME;
-                    conn.sendPacket(p);
+                    link()->sendPacket(p);
                     sentStartRequest = true;
                     std::cout << "[GUI] Sent START request\n";
                 }
@@ -165,16 +422,41 @@ private:
 
                 Packet p;
                 p.type = PacketType::PLAYER_ACTION;
-
-                if      (e.key.code == sf::Keyboard::W)     p.data["action"] = "w";
-                else if (e.key.code == sf::Keyboard::S)     p.data["action"] = "s";
-                else if (e.key.code == sf::Keyboard::A)     p.data["action"] = "a";
-                else if (e.key.code == sf::Keyboard::D)     p.data["action"] = "d";
-                else if (e.key.code == sf::Keyboard::Space) p.data["action"] = "b";
-                else if (e.key.code == sf::Keyboard::B) p.data["action"] = "b";
+                ActionType act;
+
+                if      (e.key.code == sf::Keyboard::W)     { p.data["action"] = "w"; act = ActionType::MoveUp; }
+                else if (e.key.code == sf::Keyboard::S)     { p.data["action"] = "s"; act = ActionType::MoveDown; }
+                else if (e.key.code == sf::Keyboard::A)     { p.data["action"] = "a"; act = ActionType::MoveLeft; }
+                else if (e.key.code == sf::Keyboard::D)     { p.data["action"] = "d"; act = ActionType::MoveRight; }
+                else if (e.key.code == sf::Keyboard::Space) { p.data["action"] = "b"; act = ActionType::PlaceBomb; }
+                else if (e.key.code == sf::Keyboard::B) { p.data["action"] = "b"; act = ActionType::PlaceBomb; }
                 else continue;
 
-                conn.sendPacket(p);
+                Packet u;
+                {
+                    std::lock_guard<std::mutex> lk(stateMutex);
+                    PendingInput in{nextSeq++, act};
+                    p.data["seq"] = in.seq;
+                    pending.push_back(in);
+                    applyLocalAction(view, playerId, act);   // shown this frame
+
+                    // Over UDP each datagram repeats the newest few unacked
+                    // inputs, so one lost datagram costs nothing
+                    if (udpUp) {
+                        u.type = PacketType::PLAYER_ACTION;
+                        u.data["token"] = udpToken.load();
+                        u.data["inputs"] = nlohmann::json::array();
+                        size_t from = pending.size() > (size_t)kRedundantInputs
+                                          ? pending.size() - kRedundantInputs : 0;
+                        for (size_t i = from; i < pending.size(); i++)
+                            u.data["inputs"].push_back({{"seq", pending[i].seq},
+                                                        {"action", actionKey(pending[i].act)}});
+                    }
+                }
+                if (udpUp)
+                    udpSend(udpSock, u.serialize());
+                else
+                    link()->sendPacket(p);
             }
 
 
@@ -193,15 +475,15 @@ private:
             return;
         }
 
-        drawGame();
+        {
+            std::lock_guard<std::mutex> lk(stateMutex);
+            drawGame();
+        }
         window.display();
     }
 
 
     void drawWaitingRoom() {
-        sf::Font font;
-        font.loadFromFile("/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf");
-
         sf::Text t;
         t.setFont(font);
         t.setCharacterSize(28);
@@ -217,10 +499,10 @@ private:
     }
 
 
+    // Caller holds stateMutex
     void drawGame() {
-
-        sf::Font font;
-        font.loadFromFile("/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf");
+        const GameState &state = view;
+        const float alpha = std::min(1.f, sinceSnapshot.getElapsedTime().asMilliseconds() / tickMs);
 
         sf::Text info;
         info.setFont(font);
@@ -228,23 +510,34 @@ private:
         info.setFillColor(sf::Color::White);
 
         std::string msg;
-        msg += "Player " + std::to_string(playerId) + "\n";
+        msg += playerId < 0 ? "Spectating\n" : "Player " + std::to_string(playerId) + "\n";
         msg += "Controls:\n";
         msg += "  W/A/S/D = Move\n";
         msg += "  B/SPACE = Place Bomb\n";
         msg += "  (Host Only) G = Start Game\n";
         msg += "Turn: " + std::to_string(state.turnNumber) + "\n";
 
+        const int viewW = std::min(state.width, VIEW_W);
+        const int viewH = std::min(state.height, VIEW_H);
+        int ox = 0, oy = 0;   // top-left tile on screen
+        if (const PlayerState *me = findPlayer(state, playerId)) {
+            ox = std::clamp(me->x - viewW / 2, 0, state.width - viewW);
+            oy = std::clamp(me->y - viewH / 2, 0, state.height - viewH);
+        }
+        auto onScreen = [&](int x, int y) {
+            return x >= ox && y >= oy && x < ox + viewW && y < oy + viewH;
+        };
+
         info.setString(msg);
-        info.setPosition(10, state.height * TILE + 5); 
+        info.setPosition(10, viewH * TILE + 5);
 
         window.draw(info);
         sf::RectangleShape tile(sf::Vector2f(TILE - 2, TILE - 2));
 
 
-        for (int y = 0; y < state.height; ++y) {
-            for (int x = 0; x < state.width; ++x) {
-                tile.setPosition(x * TILE, y * TILE);
+        for (int y = oy; y < oy + viewH; ++y) {
+            for (int x = ox; x < ox + viewW; ++x) {
+                tile.setPosition((x - ox) * TILE, (y - oy) * TILE);
 
                 CellType c = state.cells[y * state.width + x];
                 if (c == CellType::Wall)
@@ -256,33 +549,47 @@ private:
             }
         }
 
+        // Bombs do not move; their fuse runs down smoothly between
+        // snapshots instead, the bomb swelling and reddening to the blast
+        sf::CircleShape bombShape;
+        bombShape.setOutlineColor(sf::Color::Black);
+        bombShape.setOutlineThickness(2);
         for (auto& b : state.bombs) {
-            sf::CircleShape bombShape(TILE * 0.4f);
-            bombShape.setFillColor(sf::Color(255, 200, 0));
-            bombShape.setOutlineColor(sf::Color::Black);
-            bombShape.setOutlineThickness(2);
-            bombShape.setPosition(b.x * TILE + TILE * 0.1f,
-                                b.y * TILE + TILE * 0.1f);
+            if (!onScreen(b.x, b.y)) continue;
+            const float left = std::clamp((b.timer - alpha) / std::max(1, bombFuse), 0.f, 1.f);
+            const float r = TILE * (0.45f - 0.1f * left);
+            bombShape.setRadius(r);
+            bombShape.setFillColor(sf::Color(255, (sf::Uint8)(200 * left), 0));
+            bombShape.setPosition((b.x - ox) * TILE + TILE * 0.5f - r,
+                                  (b.y - oy) * TILE + TILE * 0.5f - r);
             window.draw(bombShape);
         }
 
 
         for (auto &c : state.lastExplosionCells) {
+            if (!onScreen(c.first, c.second)) continue;
             sf::RectangleShape exp(sf::Vector2f(TILE - 6, TILE - 6));
             exp.setFillColor(sf::Color(255, 120, 0, 180)); 
-            exp.setPosition(c.first * TILE + 3, c.second * TILE + 3);
+            exp.setPosition((c.first - ox) * TILE + 3, (c.second - oy) * TILE + 3);
             window.draw(exp);
         }
 
         for (auto& p : state.players) {
-            if (!p.alive) continue;
+            if (!p.alive || !onScreen(p.x, p.y)) continue;
 
-            if (p.id == playerId)
-                tile.setFillColor(sf::Color::Green);
-            else
+            sf::Vector2f pos((float)p.x, (float)p.y);
+            if (p.id == playerId) {
+                tile.setFillColor(sf::Color::Green);   // predicted, no delay
+            } else {
                 tile.setFillColor(sf::Color::Red);
+                auto it = prevPos.find(p.id);
+                // One-cell steps only; anything else (spawn, resync) snaps
+                if (it != prevPos.end() &&
+                    std::abs(it->second.x - pos.x) + std::abs(it->second.y - pos.y) <= 1.f)
+                    pos = it->second + (pos - it->second) * alpha;
+            }
 
-            tile.setPosition(p.x * TILE, p.y * TILE);
+            tile.setPosition((pos.x - ox) * TILE, (pos.y - oy) * TILE);
             window.draw(tile);
         }
     }
@@ -302,12 +609,15 @@ private:
 
 int main(int argc, char** argv) {
     if (argc < 3) {
-        std::cout << "Usage: bombarena_client_gui <ip> <port> <is_host>\n";
+        std::cout << "Usage: bombarena_client_gui <ip> <port> <is_host> [seat_token] [fps, 0 = vsync]\n";
         return 1;
     }
     std::cout<<"receiving start\n";
     int is_host = std::stoi(argv[3]);
-    BombArenaClientGUI gui(argv[1], std::stoi(argv[2]), is_host);
+    // Given by the player client; optional
+    std::string seat = argc > 4 ? argv[4] : "";
+    int fps = argc > 5 ? std::clamp(std::atoi(argv[5]), 0, 240) : 60;
+    BombArenaClientGUI gui(argv[1], std::stoi(argv[2]), is_host, seat, fps);
     std::cout<<"start bombarenaclient with args:"<< argv[1]<<" "<<argv[2]<<" "<<argv[3]<<"\n";
     gui.start();
     return 0;
@@ -0,0 +1,107 @@
+#include "ai.hpp"
+
+#include <chrono>
+#include <cmath>
+
+namespace bombarena {
+
+static const ActionType kMoves[] = {
+    ActionType::Stay, ActionType::MoveUp, ActionType::MoveDown,
+    ActionType::MoveLeft, ActionType::MoveRight, ActionType::PlaceBomb
+};
+constexpr int kMoveCount = 6;
+
+static int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+AiPlanner::AiPlanner(uint64_t seed) : m_rng(seed) {}
+
+// Mostly moves; a bomb one turn in twenty keeps playouts from ending in
+// everyone blowing themselves up
+ActionType AiPlanner::randomAction() {
+    uint32_t r = (uint32_t)(m_rng() % 20);
+    if (r == 0) return ActionType::PlaceBomb;
+    return kMoves[r % 5];
+}
+
+double AiPlanner::rollout(const GameState &root, int playerId, ActionType first) {
+    copyDynamicState(m_scratch, root);
+
+    int opponents = 0;
+    for (auto &p : root.players)
+        if (p.alive && p.id != playerId) opponents++;
+
+    const int depth = rolloutDepth > 0 ? rolloutDepth : root.bombFuse + 2;
+    GameResult res;
+    for (int t = 0; t < depth; t++) {
+        m_acts.clear();
+        for (auto &p : m_scratch.players) {
+            if (!p.alive) continue;
+            ActionType a = (p.id == playerId && t == 0) ? first : randomAction();
+            m_acts.push_back({p.id, a});
+        }
+        res = step(m_scratch, m_acts);
+        if (res.type != GameResultType::Ongoing) break;
+    }
+
+    if (res.type == GameResultType::PlayerWin && res.winnerId == playerId) return 1.0;
+    const PlayerState *me = findPlayer(m_scratch, playerId);
+    if (!me || !me->alive) return 0.0;
+
+    int left = 0;
+    for (auto &p : m_scratch.players)
+        if (p.alive && p.id != playerId) left++;
+    return 0.5 + (opponents ? 0.25 * (opponents - left) / opponents : 0.0);
+}
+
+ActionType AiPlanner::choose(const GameState &st, int playerId, int64_t budgetNs,
+                             long maxRollouts) {
+    m_lastRollouts = 0;
+    const PlayerState *me = findPlayer(st, playerId);
+    if (!me || !me->alive) return ActionType::Stay;
+
+    // Another map (or the first call): one full copy, then only the
+    // dynamic part per playout
+    if (m_scratch.width != st.width || m_scratch.height != st.height ||
+        m_scratch.cells != st.cells)
+        m_scratch = st;
+
+    double total[kMoveCount] = {};
+    long visits[kMoveCount] = {};
+    const int64_t end = nowNs() + budgetNs;
+
+    long n = 0;
+    while (n < maxRollouts) {
+        // Every move once, then UCB1
+        int pick = 0;
+        if (n < kMoveCount) {
+            pick = (int)n;
+        } else {
+            double best = -1;
+            for (int i = 0; i < kMoveCount; i++) {
+                double ucb = total[i] / visits[i] +
+                             explore * std::sqrt(std::log((double)n) / visits[i]);
+                if (ucb > best) { best = ucb; pick = i; }
+            }
+        }
+        total[pick] += rollout(st, playerId, kMoves[pick]);
+        visits[pick]++;
+        n++;
+
+        // The clock is cheap next to a playout, but not free
+        if ((n & 3) == 0 && nowNs() >= end) break;
+    }
+
+    m_lastRollouts = n;
+    m_totalRollouts += n;
+
+    // Most visited = most trusted
+    int best = 0;
+    for (int i = 1; i < kMoveCount; i++)
+        if (visits[i] > visits[best]) best = i;
+    return kMoves[best];
+}
+
+}
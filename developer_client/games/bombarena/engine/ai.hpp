@@ -0,0 +1,45 @@
+#pragma once
+#include "engine.hpp"
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace bombarena {
+
+// Search-based bot. Flat Monte Carlo tree search: the six first moves are
+// the tree's only level, picked by UCB1, and each visit plays the match
+// on with random moves for everyone (bombs rare) for a few turns past a
+// bomb fuse on a scratch copy of the state.
+//
+// Playout score: 1 for a win, 0 for dying, otherwise 0.5 plus up to 0.25
+// for opponents that died on the way.
+class AiPlanner {
+public:
+    explicit AiPlanner(uint64_t seed = 1);
+
+    // Best first move for `playerId` from `st`, searching until
+    // `budgetNs` has passed or `maxRollouts` playouts are done.
+    // Stay if the player is missing or dead.
+    ActionType choose(const GameState &st, int playerId, int64_t budgetNs,
+                      long maxRollouts = 1L << 30);
+
+    long lastRollouts() const { return m_lastRollouts; }   // of the last choose()
+    long totalRollouts() const { return m_totalRollouts; }
+
+    // Turns played per playout; 0 = bombFuse + 2
+    int rolloutDepth = 0;
+    double explore = 1.4;   // UCB1 exploration constant
+
+private:
+    double rollout(const GameState &root, int playerId, ActionType first);
+    ActionType randomAction();
+
+    std::mt19937_64 m_rng;
+    GameState m_scratch;                 // playout state, on the root's map
+    std::vector<PlayerAction> m_acts;
+    long m_lastRollouts = 0;
+    long m_totalRollouts = 0;
+};
+
+}
@@ -0,0 +1,280 @@
+#include "batch.hpp"
+
+#include <algorithm>
+
+namespace bombarena {
+
+static inline bool testBit(const uint64_t *bits, size_t i) { return (bits[i >> 6] >> (i & 63)) & 1; }
+static inline void setBit(uint64_t *bits, size_t i)   { bits[i >> 6] |= uint64_t(1) << (i & 63); }
+static inline void clearBit(uint64_t *bits, size_t i) { bits[i >> 6] &= ~(uint64_t(1) << (i & 63)); }
+
+void MatchBatch::init(const GameState &proto, int n) {
+    width    = proto.width;
+    height   = proto.height;
+    words    = (int)(((size_t)width * height + 63) / 64);
+    players  = (int)proto.players.size();
+    bombFuse = std::max(1, proto.bombFuse);
+    maxTurns = proto.maxTurns;
+    bombCap  = std::max(1, players * bombFuse);
+    count    = n;
+
+    ids.clear();
+    for (auto &p : proto.players) ids.push_back(p.id);
+
+    const size_t nw = (size_t)n * words, np = (size_t)n * players, nb = (size_t)n * bombCap;
+    walls.assign(nw, 0);
+    bombBits.assign(nw, 0);
+    blastBits.assign(nw, 0);
+    playerBits.assign(nw, 0);
+    px.assign(np, 0);
+    py.assign(np, 0);
+    alive.assign(np, 0);
+    range.assign(np, 0);
+    bx.assign(nb, 0);
+    by.assign(nb, 0);
+    timer.assign(nb, 0);
+    owner.assign(nb, 0);
+    brange.assign(nb, 0);
+    bombCount.assign(n, 0);
+    turn.assign(n, 0);
+    result.assign(n, GameResult{});
+    work.reserve(bombCap);
+
+    for (int m = 0; m < n; m++) load(m, proto);
+}
+
+void MatchBatch::load(int m, const GameState &st) {
+    uint64_t *wl = &walls[(size_t)m * words];
+    uint64_t *bb = &bombBits[(size_t)m * words];
+    uint64_t *pb = &playerBits[(size_t)m * words];
+    std::fill(wl, wl + words, 0);
+    std::fill(bb, bb + words, 0);
+    std::fill(pb, pb + words, 0);
+    std::fill(&blastBits[(size_t)m * words], &blastBits[(size_t)m * words] + words, 0);
+
+    for (size_t i = 0; i < st.cells.size(); i++)
+        if (st.cells[i] == CellType::Wall) setBit(wl, i);
+
+    for (int p = 0; p < players; p++) {
+        const PlayerState &ps = st.players[p];
+        size_t k = (size_t)m * players + p;
+        px[k] = (int16_t)ps.x;
+        py[k] = (int16_t)ps.y;
+        alive[k] = ps.alive;
+        range[k] = (uint8_t)ps.bombRange;
+        if (ps.alive) setBit(pb, (size_t)ps.y * width + ps.x);
+    }
+
+    int n = std::min((int)st.bombs.size(), bombCap);
+    for (int i = 0; i < n; i++) {
+        const Bomb &b = st.bombs[i];
+        size_t k = (size_t)m * bombCap + i;
+        bx[k] = (int16_t)b.x;
+        by[k] = (int16_t)b.y;
+        timer[k] = (int16_t)b.timer;
+        owner[k] = (int16_t)b.ownerId;
+        brange[k] = (uint8_t)b.range;
+        setBit(bb, (size_t)b.y * width + b.x);
+    }
+    bombCount[m] = n;
+    turn[m] = st.turnNumber;
+    result[m] = GameResult{};
+}
+
+GameState MatchBatch::extract(int m) const {
+    GameState st;
+    st.width = width;
+    st.height = height;
+    st.bombFuse = bombFuse;
+    st.maxTurns = maxTurns;
+    st.turnNumber = turn[m];
+
+    const uint64_t *wl = &walls[(size_t)m * words];
+    const uint64_t *xb = &blastBits[(size_t)m * words];
+    st.cells.resize((size_t)width * height);
+    for (size_t i = 0; i < st.cells.size(); i++) {
+        st.cells[i] = testBit(wl, i) ? CellType::Wall : CellType::Empty;
+        if (testBit(xb, i)) st.lastExplosionCells.emplace_back((int)(i % width), (int)(i / width));
+    }
+
+    for (int p = 0; p < players; p++) {
+        size_t k = (size_t)m * players + p;
+        PlayerState ps;
+        ps.id = ids[p];
+        ps.x = px[k];
+        ps.y = py[k];
+        ps.alive = alive[k] != 0;
+        ps.bombRange = range[k];
+        st.players.push_back(ps);
+    }
+    for (int i = 0; i < bombCount[m]; i++) {
+        size_t k = (size_t)m * bombCap + i;
+        Bomb b;
+        b.x = bx[k];
+        b.y = by[k];
+        b.timer = timer[k];
+        b.ownerId = owner[k];
+        b.range = brange[k];
+        st.bombs.push_back(b);
+    }
+    rebuildOccupancy(st);
+    return st;
+}
+
+// ---------------------------------------------------------------
+// Phases. Each works on one match; stepBatch() runs them match by match
+// so a match's few kilobytes stay in L1 for the whole tick.
+// ---------------------------------------------------------------
+
+static void movePlayers(MatchBatch &b, int m, const ActionType *acts) {
+    const int w = b.width, h = b.height;
+    const uint64_t *wl = &b.walls[(size_t)m * b.words];
+    uint64_t *bb = &b.bombBits[(size_t)m * b.words];
+    uint64_t *pb = &b.playerBits[(size_t)m * b.words];
+    const size_t p0 = (size_t)m * b.players;
+
+    for (int p = 0; p < b.players; p++) {
+        const size_t k = p0 + p;
+        if (!b.alive[k]) continue;
+        const int x = b.px[k], y = b.py[k];
+
+        int dx = 0, dy = 0;
+        switch (acts[p]) {
+            case ActionType::MoveUp:    dy = -1; break;
+            case ActionType::MoveDown:  dy =  1; break;
+            case ActionType::MoveLeft:  dx = -1; break;
+            case ActionType::MoveRight: dx =  1; break;
+            case ActionType::PlaceBomb: {
+                const size_t c = (size_t)y * w + x;
+                if (testBit(bb, c) || b.bombCount[m] == b.bombCap) continue;
+                const size_t j = (size_t)m * b.bombCap + b.bombCount[m]++;
+                b.bx[j] = (int16_t)x;
+                b.by[j] = (int16_t)y;
+                b.timer[j] = (int16_t)b.bombFuse;
+                b.owner[j] = (int16_t)b.ids[p];
+                b.brange[j] = b.range[k];
+                setBit(bb, c);
+                continue;
+            }
+            default: continue;
+        }
+
+        const int nx = x + dx, ny = y + dy;
+        if (nx < 0 || ny < 0 || nx >= w || ny >= h) continue;
+        const size_t c = (size_t)ny * w + nx;
+        if (testBit(wl, c) || testBit(pb, c)) continue;
+        clearBit(pb, (size_t)y * w + x);
+        setBit(pb, c);
+        b.px[k] = (int16_t)nx;
+        b.py[k] = (int16_t)ny;
+    }
+}
+
+// Same chain rules as detonateBombs(): a ray passes through bombs and sets
+// off each one it crosses this turn. The blasted cells do not depend on the order the
+// chain is walked in, so a bomb is looked up by scanning the (few) bombs
+// of the match instead of keeping a cell -> bomb map.
+static void detonate(MatchBatch &b, int m) {
+    static const int dirs[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+    const int w = b.width, h = b.height;
+    const uint64_t *wl = &b.walls[(size_t)m * b.words];
+    uint64_t *bb = &b.bombBits[(size_t)m * b.words];
+    uint64_t *xb = &b.blastBits[(size_t)m * b.words];
+
+    const size_t base = (size_t)m * b.bombCap;
+    const int n = b.bombCount[m];
+    int16_t *bx = &b.bx[base], *by = &b.by[base], *tm = &b.timer[base];
+
+    for (int i = 0; i < n; i++) tm[i]--;   // vectorises
+
+    auto &work = b.work;
+    work.clear();
+    for (int i = 0; i < n; i++)
+        if (tm[i] <= 0) work.push_back(i);
+
+    while (!work.empty()) {
+        const int i = work.back();
+        work.pop_back();
+        setBit(xb, (size_t)by[i] * w + bx[i]);
+
+        for (auto &d : dirs) {
+            int cx = bx[i], cy = by[i];
+            for (int r = 0; r < b.brange[base + i]; r++) {
+                cx += d[0];
+                cy += d[1];
+                if (cx < 0 || cy < 0 || cx >= w || cy >= h) break;
+                const size_t c = (size_t)cy * w + cx;
+                if (testBit(wl, c)) break;
+                setBit(xb, c);
+                if (!testBit(bb, c)) continue;
+
+                for (int j = 0; j < n; j++)
+                    if (bx[j] == cx && by[j] == cy) {
+                        if (tm[j] > 0) {
+                            tm[j] = 0;
+                            work.push_back(j);
+                        }
+                        break;
+                    }
+            }
+        }
+    }
+
+    // Compact in place, keeping placement order
+    int keep = 0;
+    for (int i = 0; i < n; i++) {
+        if (tm[i] <= 0) {
+            clearBit(bb, (size_t)by[i] * w + bx[i]);
+            continue;
+        }
+        if (keep != i) {
+            bx[keep] = bx[i];
+            by[keep] = by[i];
+            tm[keep] = tm[i];
+            b.owner[base + keep]  = b.owner[base + i];
+            b.brange[base + keep] = b.brange[base + i];
+        }
+        keep++;
+    }
+    b.bombCount[m] = keep;
+}
+
+static GameResult damageAndScore(MatchBatch &b, int m) {
+    const uint64_t *xb = &b.blastBits[(size_t)m * b.words];
+    uint64_t *pb = &b.playerBits[(size_t)m * b.words];
+    const size_t p0 = (size_t)m * b.players;
+
+    int aliveCount = 0, lastAliveId = -1;
+    for (int p = 0; p < b.players; p++) {
+        const size_t k = p0 + p;
+        if (!b.alive[k]) continue;
+        const size_t c = (size_t)b.py[k] * b.width + b.px[k];
+        if (testBit(xb, c)) {
+            b.alive[k] = 0;
+            clearBit(pb, c);
+            continue;
+        }
+        aliveCount++;
+        lastAliveId = b.ids[p];
+    }
+
+    if (aliveCount == 1) return GameResult{GameResultType::PlayerWin, lastAliveId};
+    if (aliveCount == 0) return GameResult{GameResultType::Draw, -1};
+    if (b.turn[m] > b.maxTurns) return GameResult{GameResultType::Draw, -1};
+    return GameResult{GameResultType::Ongoing, -1};
+}
+
+void stepBatch(MatchBatch &b, const ActionType *actions) {
+    const size_t words = b.words;
+    for (int m = 0; m < b.count; m++) {
+        if (b.result[m].type != GameResultType::Ongoing) continue;
+
+        b.turn[m]++;
+        std::fill_n(&b.blastBits[m * words], words, 0);
+        movePlayers(b, m, actions + (size_t)m * b.players);
+        detonate(b, m);
+        b.result[m] = damageAndScore(b, m);
+    }
+}
+
+}
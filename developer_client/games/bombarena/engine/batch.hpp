@@ -0,0 +1,55 @@
+#pragma once
+#include "engine.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace bombarena {
+
+// Many independent matches of the same shape (map size, player count,
+// rules) in structure-of-arrays form, stepped together by stepBatch().
+// For bulk simulation (bots, tests) and servers hosting many rooms.
+//
+// Match m's data sits at a fixed stride in every array:
+//   bitboards  [m * words, (m + 1) * words)      one bit per cell, row-major
+//   players    [m * players, (m + 1) * players)  same order as the GameState
+//   bombs      [m * bombCap, m * bombCap + bombCount[m])  placement order
+// so each phase of a tick is a short loop over contiguous memory.
+struct MatchBatch {
+    int width = 0, height = 0;
+    int words = 0;          // uint64_t per bitboard
+    int players = 0;        // per match
+    int bombCap = 0;        // per match: players * bombFuse
+    int bombFuse = 10;
+    int maxTurns = 200;
+    int count = 0;          // matches
+
+    std::vector<int> ids;   // player ids, shared by every match
+
+    std::vector<uint64_t> walls, bombBits, blastBits, playerBits;
+
+    std::vector<int16_t> px, py;
+    std::vector<uint8_t> alive, range;
+
+    std::vector<int16_t> bx, by, timer, owner;
+    std::vector<uint8_t> brange;
+    std::vector<int> bombCount;
+
+    std::vector<int> turn;
+    std::vector<GameResult> result;   // matches that ended are left as they are
+
+    std::vector<int> work;   // detonation scratch, one match at a time
+
+    // `count` copies of `proto`. Every later load() must have the same
+    // map size, players (ids in the same order) and rules.
+    void init(const GameState &proto, int count);
+    void load(int m, const GameState &st);
+    // Back to a GameState; lastExplosionCells comes out row-major
+    GameState extract(int m) const;
+};
+
+// Advances every ongoing match one turn with the rules of step().
+// actions[m * b.players + p] is player p's input in match m.
+void stepBatch(MatchBatch &b, const ActionType *actions);
+
+}
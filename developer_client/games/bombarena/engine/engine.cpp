@@ -1,7 +1,6 @@
 #include "engine.hpp"
 #include <algorithm>
 #include <sstream>
-#include <iostream>
 
 namespace bombarena {
 
@@ -20,6 +19,11 @@ void setCell(GameState &state, int x, int y, CellType t) {
 }
 
 PlayerState* findPlayer(GameState &state, int playerId) {
+    if (playerId >= 0 && playerId < (int)state.playerIndex.size()) {
+        int i = state.playerIndex[playerId];
+        if (i >= 0 && i < (int)state.players.size() && state.players[i].id == playerId)
+            return &state.players[i];
+    }
     for (auto &p : state.players) {
         if (p.id == playerId) return &p;
     }
@@ -27,10 +31,126 @@ PlayerState* findPlayer(GameState &state, int playerId) {
 }
 
 const PlayerState* findPlayer(const GameState &state, int playerId) {
-    for (auto &p : state.players) {
-        if (p.id == playerId) return &p;
+    return findPlayer(const_cast<GameState&>(state), playerId);
+}
+
+// Upper bounds that hold for the whole game: a player can have at most one
+// bomb per fuse turn in play, and a turn cannot blast more cells than the
+// map has. Reserving them once keeps step() from ever reallocating.
+static void reserveScratch(GameState &st) {
+    size_t cells = (size_t)st.width * st.height;
+    size_t maxBombs = st.players.size() * st.bombFuse;
+    st.bombs.reserve(maxBombs);
+    st.detonations.reserve(maxBombs);
+    st.lastExplosionCells.reserve(cells);
+    st.actionById.reserve(st.playerIndex.size());
+}
+
+// splitmix64 finaliser
+static uint64_t mix64(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+uint64_t playerHashKey(const PlayerState &p) {
+    uint64_t v = (uint64_t)(uint32_t)p.id << 33 | (uint64_t)(uint16_t)p.x << 17 |
+                 (uint64_t)(uint16_t)p.y << 1 | (p.alive ? 1 : 0);
+    return mix64(v);
+}
+
+uint64_t bombHashKey(const Bomb &b, int turn) {
+    uint64_t v = (uint64_t)(uint16_t)b.x << 48 | (uint64_t)(uint16_t)b.y << 32 |
+                 (uint64_t)(uint16_t)b.ownerId << 16 | (uint16_t)b.range;
+    return mix64(mix64(v) + (uint32_t)(turn + b.timer));
+}
+
+uint64_t computeStateHash(const GameState &st) {
+    uint64_t h = 0;
+    for (auto &p : st.players) h ^= playerHashKey(p);
+    for (auto &b : st.bombs)   h ^= bombHashKey(b, st.turnNumber);
+    return h;
+}
+
+void rebuildOccupancy(GameState &st) {
+    if (st.wallBits.width != st.width || st.wallBits.height != st.height ||
+        st.wallBits.words.empty()) {
+        st.wallBits.reset(st.width, st.height);
+        st.bombBits.reset(st.width, st.height);
+        st.blastBits.reset(st.width, st.height);
+        st.playerBits.reset(st.width, st.height);
+    } else {
+        st.wallBits.clear();
+        st.bombBits.clear();
+        st.blastBits.clear();
+        st.playerBits.clear();
+    }
+
+    for (int y = 0; y < st.height; ++y)
+        for (int x = 0; x < st.width; ++x)
+            if (st.cells[y * st.width + x] == CellType::Wall)
+                st.wallBits.set(x, y);
+
+    for (auto &b : st.bombs)
+        if (inBounds(st, b.x, b.y)) st.bombBits.set(b.x, b.y);
+
+    st.bombAt.assign((size_t)st.width * st.height, -1);
+
+    int maxId = 0;
+    for (auto &p : st.players) maxId = std::max(maxId, p.id);
+    st.playerIndex.assign(maxId + 1, -1);
+    for (size_t i = 0; i < st.players.size(); ++i) {
+        const PlayerState &p = st.players[i];
+        if (p.id >= 0) st.playerIndex[p.id] = (int)i;
+        if (p.alive && inBounds(st, p.x, p.y)) st.playerBits.set(p.x, p.y);
+    }
+
+    st.hash = computeStateHash(st);
+    reserveScratch(st);
+}
+
+// Layers that change every tick; walls are only redone when the map size
+// changes (or the layers were never built)
+static void refreshOccupancy(GameState &st) {
+    if (st.wallBits.width != st.width || st.wallBits.height != st.height ||
+        st.wallBits.words.empty() || st.playerIndex.empty() ||
+        st.bombAt.size() != (size_t)st.width * st.height) {
+        rebuildOccupancy(st);
+        return;
+    }
+
+    st.bombBits.clear();
+    st.blastBits.clear();
+    st.playerBits.clear();
+    for (auto &b : st.bombs)
+        if (inBounds(st, b.x, b.y)) st.bombBits.set(b.x, b.y);
+
+    for (size_t i = 0; i < st.players.size(); ++i) {
+        const PlayerState &p = st.players[i];
+        if (p.id >= 0 && p.id >= (int)st.playerIndex.size()) {
+            st.playerIndex.resize(p.id + 1, -1);
+            reserveScratch(st);
+        }
+        if (p.id >= 0) st.playerIndex[p.id] = (int)i;
+        if (p.alive && inBounds(st, p.x, p.y)) st.playerBits.set(p.x, p.y);
     }
-    return nullptr;
+}
+
+void copyDynamicState(GameState &dst, const GameState &src) {
+    // A plain copy only has capacity for what src held at the time
+    if (dst.bombs.capacity() < src.players.size() * src.bombFuse ||
+        dst.lastExplosionCells.capacity() < dst.cells.size()) {
+        dst.bombs.reserve(src.players.size() * src.bombFuse);
+        dst.detonations.reserve(src.players.size() * src.bombFuse);
+        dst.lastExplosionCells.reserve(dst.cells.size());
+    }
+    dst.players.assign(src.players.begin(), src.players.end());
+    dst.bombs.assign(src.bombs.begin(), src.bombs.end());
+    dst.lastExplosionCells.clear();
+    dst.hash = src.hash;
+    dst.turnNumber = src.turnNumber;
+    dst.bombFuse = src.bombFuse;
+    dst.maxTurns = src.maxTurns;
 }
 
 
@@ -62,6 +182,44 @@ GameState initTwoPlayerDefault() {
 }
 
 
+GameState initArena(int w, int h, int numPlayers) {
+    GameState st;
+    st.width = std::max(w, 5);
+    st.height = std::max(h, 5);
+    st.cells.assign(st.width * st.height, CellType::Empty);
+
+    for (int y = 0; y < st.height; ++y) {
+        for (int x = 0; x < st.width; ++x) {
+            bool border = x == 0 || y == 0 || x == st.width - 1 || y == st.height - 1;
+            bool pillar = (x % 2 == 0) && (y % 2 == 0);
+            if (border || pillar) setCell(st, x, y, CellType::Wall);
+        }
+    }
+
+    // Spawn on odd/odd cells (never pillars), walking a coarse lattice so
+    // players start spread out instead of clustered in one corner
+    std::vector<std::pair<int,int>> spots;
+    for (int y = 1; y < st.height - 1; y += 2)
+        for (int x = 1; x < st.width - 1; x += 2)
+            spots.emplace_back(x, y);
+
+    size_t n = std::min<size_t>(std::max(0, numPlayers), spots.size());
+    size_t stride = n ? spots.size() / n : 1;
+    for (size_t i = 0; i < n; ++i) {
+        auto &c = spots[i * stride];
+        PlayerState p;
+        p.id = (int)i + 1;
+        p.x = c.first;
+        p.y = c.second;
+        st.players.push_back(p);
+    }
+
+    st.turnNumber = 0;
+    rebuildOccupancy(st);
+    return st;
+}
+
+
 static void applyMovement(GameState &st, PlayerState &pl, ActionType act) {
     int dx = 0, dy = 0;
     switch (act) {
@@ -75,85 +233,126 @@ static void applyMovement(GameState &st, PlayerState &pl, ActionType act) {
     int nx = pl.x + dx;
     int ny = pl.y + dy;
     if (!inBounds(st, nx, ny)) return;
-    if (getCell(st, nx, ny) == CellType::Wall) return;
-
-
-    for (const auto &other : st.players) {
-        if (other.id != pl.id && other.alive && other.x == nx && other.y == ny) {
-            return;
-        }
-    }
+    if (st.wallBits.test(nx, ny)) return;
+    if (st.playerBits.test(nx, ny)) return;   // alive players only
 
+    st.playerBits.unset(pl.x, pl.y);
+    st.playerBits.set(nx, ny);
+    st.hash ^= playerHashKey(pl);
     pl.x = nx;
     pl.y = ny;
+    st.hash ^= playerHashKey(pl);
 }
 
 
 static void tryPlaceBomb(GameState &st, const PlayerState &pl) {
-    std::cout << "tryPlaceBomb called for player=" << pl.id
-          << " at (" << pl.x << "," << pl.y << ")\n";
-
-    for (const auto &b : st.bombs) {
-        if (b.x == pl.x && b.y == pl.y) return;
-    }
+    if (st.bombBits.test(pl.x, pl.y)) return;
     Bomb b;
     b.x = pl.x;
     b.y = pl.y;
     b.ownerId = pl.id;
-    b.timer = 10;
+    b.timer = st.bombFuse;
     b.range = pl.bombRange;
     st.bombs.push_back(b);
+    st.bombBits.set(b.x, b.y);
+    // Keyed as of the end of the turn, after detonateBombs() has ticked
+    // its timer once: turnNumber + (timer - 1)
+    st.hash ^= bombHashKey(b, st.turnNumber - 1);
 }
 
 
-static std::vector<std::pair<int,int>> explodeBomb(const GameState &st, const Bomb &b) {
-    std::vector<std::pair<int,int>> cells;
-    cells.emplace_back(b.x, b.y);
+static void blastCell(GameState &st, int x, int y) {
+    if (st.blastBits.test(x, y)) return;
+    st.blastBits.set(x, y);
+    st.lastExplosionCells.emplace_back(x, y);
+}
 
-    const int dirs[4][2] = {
+// Ticks every fuse, then detonates everything that is due plus whatever
+// those blasts reach. A ray passes through bombs, as it always did, and
+// sets off each one it crosses in the same turn. Each cell is recorded
+// once in blastBits / lastExplosionCells however many rays cross it.
+static void detonateBombs(GameState &st) {
+    static const int dirs[4][2] = {
         { 1, 0}, {-1, 0}, {0,  1}, {0, -1}
     };
 
-    for (auto &d : dirs) {
-        int cx = b.x;
-        int cy = b.y;
-        for (int r = 0; r < b.range; ++r) {
-            cx += d[0];
-            cy += d[1];
-            if (!inBounds(st, cx, cy)) break;
-            if (getCell(st, cx, cy) == CellType::Wall) break;
-            cells.emplace_back(cx, cy);
+    auto &work = st.detonations;
+    work.clear();
+
+    for (size_t i = 0; i < st.bombs.size(); ++i) {
+        Bomb &b = st.bombs[i];
+        st.bombAt[(size_t)b.y * st.width + b.x] = (int)i;
+        if (--b.timer <= 0) {
+            st.hash ^= bombHashKey(b, st.turnNumber);
+            work.push_back((int)i);
         }
     }
 
-    return cells;
+    // timer <= 0 marks a bomb as detonated (or queued to)
+    while (!work.empty()) {
+        const Bomb b = st.bombs[work.back()];
+        work.pop_back();
+
+        blastCell(st, b.x, b.y);
+        for (auto &d : dirs) {
+            int cx = b.x;
+            int cy = b.y;
+            for (int r = 0; r < b.range; ++r) {
+                cx += d[0];
+                cy += d[1];
+                if (!inBounds(st, cx, cy)) break;
+                if (st.wallBits.test(cx, cy)) break;
+                blastCell(st, cx, cy);
+
+                int hit = st.bombAt[(size_t)cy * st.width + cx];
+                if (hit >= 0) {
+                    Bomb &other = st.bombs[hit];
+                    if (other.timer > 0) {
+                        st.hash ^= bombHashKey(other, st.turnNumber);
+                        other.timer = 0;
+                        work.push_back(hit);
+                    }
+                }
+            }
+        }
+    }
+
+    // Compact in place, keeping placement order; leave bombAt all -1
+    size_t keep = 0;
+    for (size_t i = 0; i < st.bombs.size(); ++i) {
+        const Bomb &b = st.bombs[i];
+        st.bombAt[(size_t)b.y * st.width + b.x] = -1;
+        if (b.timer <= 0) {
+            st.bombBits.unset(b.x, b.y);
+            continue;
+        }
+        st.bombs[keep++] = b;
+    }
+    st.bombs.resize(keep);
 }
 
 
-static void applyExplosionDamage(GameState &st,
-                                 const std::vector<std::pair<int,int>> &explCells) {
+static void applyExplosionDamage(GameState &st) {
     for (auto &p : st.players) {
-        if (!p.alive) continue;
-        for (auto &c : explCells) {
-            if (p.x == c.first && p.y == c.second) {
-                p.alive = false;
-                break;
-            }
+        if (p.alive && st.blastBits.test(p.x, p.y)) {
+            st.hash ^= playerHashKey(p);
+            p.alive = false;
+            st.hash ^= playerHashKey(p);
+            st.playerBits.unset(p.x, p.y);
         }
     }
 }
 
 GameResult step(GameState &st, const std::vector<PlayerAction> &actions) {
+    // Before the turn advances: a rebuilt hash keys bombs by this turn
+    refreshOccupancy(st);
     st.turnNumber++;
     st.lastExplosionCells.clear();
 
 
-    std::vector<ActionType> actionById;
-    int maxId = 0;
-    for (auto &pl : st.players) {
-        maxId = std::max(maxId, pl.id);
-    }
-    actionById.assign(maxId + 1, ActionType::Stay);
+    // playerIndex covers every id after refreshOccupancy()
+    auto &actionById = st.actionById;
+    actionById.assign(st.playerIndex.size(), ActionType::Stay);
     for (auto &a : actions) {
         if (a.playerId >= 0 && a.playerId < (int)actionById.size()) {
             actionById[a.playerId] = a.type;
@@ -178,25 +377,8 @@ GameResult step(GameState &st, const std::vector<PlayerAction> &actions) {
     }
 
 
-    std::vector<Bomb> remaining;
-    std::vector<std::pair<int,int>> explosionCellsTotal;
-
-    for (auto &b : st.bombs) {
-        Bomb nb = b;
-        nb.timer--;
-        if (nb.timer <= 0) {
-            auto cells = explodeBomb(st, nb);
-            explosionCellsTotal.insert(explosionCellsTotal.end(),
-                                       cells.begin(), cells.end());
-        } else {
-            remaining.push_back(nb);
-        }
-    }
-    st.bombs.swap(remaining);
-    st.lastExplosionCells = explosionCellsTotal;
-
-
-    applyExplosionDamage(st, explosionCellsTotal);
+    detonateBombs(st);
+    applyExplosionDamage(st);
 
 
     int aliveCount = 0;
@@ -215,13 +397,24 @@ GameResult step(GameState &st, const std::vector<PlayerAction> &actions) {
         return GameResult{GameResultType::Draw, -1};
     }
 
-    if (st.turnNumber > 200) {
+    if (st.turnNumber > st.maxTurns) {
         return GameResult{GameResultType::Draw, -1};
     }
 
     return GameResult{GameResultType::Ongoing, -1};
 }
 
+void applyLocalAction(GameState &st, int playerId, ActionType act) {
+    refreshOccupancy(st);
+    PlayerState *pl = findPlayer(st, playerId);
+    if (!pl || !pl->alive) return;
+
+    if (act == ActionType::PlaceBomb)
+        tryPlaceBomb(st, *pl);
+    else if (act != ActionType::Stay)
+        applyMovement(st, *pl, act);
+}
+
 std::string renderBoard(const GameState &st) {
     std::vector<std::string> grid(st.height, std::string(st.width, ' '));
 
@@ -1,4 +1,6 @@
 #pragma once
+#include <algorithm>
+#include <cstdint>
 #include <vector>
 #include <string>
 #include <utility>
@@ -7,7 +9,7 @@ namespace bombarena {
 
 
 
-enum class CellType {
+enum class CellType : uint8_t {
     Empty,
     Wall
 };
@@ -56,25 +58,103 @@ struct GameResult {
     int winnerId = -1;
 };
 
+// One bit per cell, row-major. Out-of-range reads return false.
+struct BitGrid {
+    int width = 0;
+    int height = 0;
+    std::vector<uint64_t> words;
+
+    void reset(int w, int h) {
+        width = w;
+        height = h;
+        words.assign(((size_t)w * h + 63) / 64, 0);
+    }
+    void clear() { std::fill(words.begin(), words.end(), 0); }
+
+    bool test(int x, int y) const {
+        if (x < 0 || y < 0 || x >= width || y >= height) return false;
+        size_t i = (size_t)y * width + x;
+        return (words[i >> 6] >> (i & 63)) & 1;
+    }
+    void set(int x, int y) {
+        size_t i = (size_t)y * width + x;
+        words[i >> 6] |= uint64_t(1) << (i & 63);
+    }
+    void unset(int x, int y) {
+        size_t i = (size_t)y * width + x;
+        words[i >> 6] &= ~(uint64_t(1) << (i & 63));
+    }
+};
+
 struct GameState {
     int width = 11;
     int height = 11;
 
     std::vector<CellType> cells;
 
+    // Occupancy layers for O(1) collision tests. step() refreshes them at
+    // the start of every tick from cells/players/bombs, so code that edits
+    // those directly does not need to keep them in sync.
+    BitGrid wallBits;
+    BitGrid bombBits;
+    BitGrid blastBits;      // cells hit this turn
+    BitGrid playerBits;     // alive players
+    std::vector<int> playerIndex;   // player id -> index in players, -1 if none
+
+    // Detonation scratch, sized once per map. bombAt maps a cell to its
+    // index in bombs while step() runs and is all -1 in between.
+    std::vector<int> bombAt;
+    std::vector<int> detonations;   // worklist of bomb indices
+    std::vector<ActionType> actionById;   // this tick's input per player id
+
     std::vector<PlayerState> players;
 
     std::vector<Bomb> bombs;
 
+    // Zobrist hash of players and bombs: the XOR of playerHashKey() and
+    // bombHashKey() over all of them. step() updates it per event;
+    // rebuildOccupancy() recomputes it, so code that edits players or
+    // bombs directly calls that (or sets it from computeStateHash()).
+    uint64_t hash = 0;
+
     int turnNumber = 0;
 
+    // Rules counted in turns; a server ticking faster scales them up so
+    // games last the same wall-clock time
+    int bombFuse = 10;    // turns from placement to detonation
+    int maxTurns = 200;   // draw once this many turns have passed
+
     std::vector<std::pair<int,int>> lastExplosionCells;
 };
 
 
 
 GameState initTwoPlayerDefault();
+// w x h arena: border walls, a pillar on every even (x, y), and
+// numPlayers players (ids 1..n) spread over the open cells.
+GameState initArena(int w, int h, int numPlayers);
+// Rebuilds the occupancy layers, player index and hash
+void rebuildOccupancy(GameState &st);
+// Zobrist keys, derived from the fields with a 64-bit mixer rather than
+// looked up in random tables so any map size or id works. A player's key
+// covers what snapshots carry (id, position, alive); a bomb's uses the
+// turn it is due to go off (turn + timer), which stays fixed while its
+// timer runs down, so only placing, moving, dying and detonating change
+// the hash.
+uint64_t playerHashKey(const PlayerState &p);
+uint64_t bombHashKey(const Bomb &b, int turn);
+uint64_t computeStateHash(const GameState &st);
+// Cheap clone for search: copies only what step() evolves (players, bombs,
+// turn, rules) into `dst`, which must already hold the same map (a full
+// copy of `src` or an earlier state of the same match). Reuses dst's
+// storage, so a warmed-up dst never allocates.
+void copyDynamicState(GameState &dst, const GameState &src);
+PlayerState* findPlayer(GameState &state, int playerId);
+const PlayerState* findPlayer(const GameState &state, int playerId);
 GameResult step(GameState &st, const std::vector<PlayerAction>& actions);
+// Client-side prediction: applies one player's move / bomb placement with
+// step()'s rules, without advancing the turn or detonating anything
+void applyLocalAction(GameState &st, int playerId, ActionType act);
 std::string renderBoard(const GameState &st);
 
 } 
@@ -0,0 +1,248 @@
+#include "replay.hpp"
+
+#include <cstring>
+
+namespace bombarena {
+
+// ---------------------------------------------------------------
+// Encoding helpers
+// ---------------------------------------------------------------
+
+static void putU8(std::string &b, uint8_t v) { b.push_back((char)v); }
+
+static void putLE(std::string &b, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) b.push_back((char)((v >> (8 * i)) & 0xff));
+}
+
+static void putVar(std::string &b, uint64_t v) {
+    while (v >= 0x80) {
+        b.push_back((char)((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    b.push_back((char)v);
+}
+
+namespace {
+struct Cursor {
+    const std::vector<uint8_t> &d;
+    size_t &pos;
+    bool ok = true;
+
+    uint8_t u8() {
+        if (pos >= d.size()) { ok = false; return 0; }
+        return d[pos++];
+    }
+    uint64_t le(int bytes) {
+        uint64_t v = 0;
+        for (int i = 0; i < bytes; i++) v |= (uint64_t)u8() << (8 * i);
+        return v;
+    }
+    uint64_t var() {
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t c = u8();
+            v |= (uint64_t)(c & 0x7f) << shift;
+            if (!(c & 0x80)) return v;
+        }
+        ok = false;
+        return 0;
+    }
+};
+}
+
+// FNV-1a over the evolving parts of the state
+uint64_t stateChecksum(const GameState &st) {
+    uint64_t h = 1469598103934665603ull;
+    auto mix = [&h](int64_t v) {
+        for (int i = 0; i < 8; i++) {
+            h ^= (uint64_t)(v >> (8 * i)) & 0xff;
+            h *= 1099511628211ull;
+        }
+    };
+    mix(st.turnNumber);
+    for (auto &p : st.players) {
+        mix(p.id); mix(p.x); mix(p.y); mix(p.alive); mix(p.bombRange);
+    }
+    for (auto &b : st.bombs) {
+        mix(b.x); mix(b.y); mix(b.ownerId); mix(b.timer); mix(b.range);
+    }
+    return h;
+}
+
+// ---------------------------------------------------------------
+// Writer
+// ---------------------------------------------------------------
+
+bool ReplayWriter::open(const std::string &path, const GameState &initial, int tickHz) {
+    close();
+    m_file = std::fopen(path.c_str(), "wb");
+    if (!m_file) return false;
+
+    m_buf.clear();
+    m_buf.append("BARP", 4);
+    putLE(m_buf, kReplayVersion, 2);
+    putLE(m_buf, (uint64_t)tickHz, 2);
+    putLE(m_buf, (uint64_t)initial.width, 2);
+    putLE(m_buf, (uint64_t)initial.height, 2);
+    putLE(m_buf, (uint64_t)initial.bombFuse, 4);
+    putLE(m_buf, (uint64_t)initial.maxTurns, 4);
+    for (CellType c : initial.cells) putU8(m_buf, (uint8_t)c);
+
+    putVar(m_buf, initial.players.size());
+    for (auto &p : initial.players) {
+        putVar(m_buf, (uint64_t)p.id);
+        putVar(m_buf, (uint64_t)p.x);
+        putVar(m_buf, (uint64_t)p.y);
+        putU8(m_buf, p.alive ? 1 : 0);
+        putVar(m_buf, (uint64_t)p.bombRange);
+    }
+    flushBuf();
+    return true;
+}
+
+void ReplayWriter::tick(const std::vector<PlayerAction> &actions) {
+    if (!m_file) return;
+    m_buf.clear();
+    putU8(m_buf, (uint8_t)ReplayTag::Tick);
+    putVar(m_buf, actions.size());
+    for (auto &a : actions) {
+        putVar(m_buf, (uint64_t)a.playerId);
+        putU8(m_buf, (uint8_t)a.type);
+    }
+    flushBuf();
+}
+
+void ReplayWriter::checksum(const GameState &st) {
+    if (!m_file) return;
+    m_buf.clear();
+    putU8(m_buf, (uint8_t)ReplayTag::Checksum);
+    putVar(m_buf, (uint64_t)st.turnNumber);
+    putLE(m_buf, stateChecksum(st), 8);
+    flushBuf();
+}
+
+void ReplayWriter::finish(const GameResult &res, const GameState &st) {
+    if (!m_file) return;
+    m_buf.clear();
+    putU8(m_buf, (uint8_t)ReplayTag::End);
+    putVar(m_buf, (uint64_t)st.turnNumber);
+    putU8(m_buf, (uint8_t)res.type);
+    putVar(m_buf, (uint64_t)(res.winnerId + 1));
+    putLE(m_buf, stateChecksum(st), 8);
+    flushBuf();
+    close();
+}
+
+void ReplayWriter::close() {
+    if (m_file) {
+        std::fclose(m_file);
+        m_file = nullptr;
+    }
+}
+
+// stdio buffers the small records; a crash loses at most that buffer
+void ReplayWriter::flushBuf() {
+    std::fwrite(m_buf.data(), 1, m_buf.size(), m_file);
+}
+
+// ---------------------------------------------------------------
+// Reader
+// ---------------------------------------------------------------
+
+bool ReplayReader::open(const std::string &path, GameState &initial, std::string &err) {
+    m_data.clear();
+    m_pos = m_start = 0;
+    m_bad = false;
+
+    std::FILE *f = std::fopen(path.c_str(), "rb");
+    if (!f) { err = "cannot open " + path; return false; }
+    uint8_t chunk[65536];
+    size_t n;
+    while ((n = std::fread(chunk, 1, sizeof(chunk), f)) > 0)
+        m_data.insert(m_data.end(), chunk, chunk + n);
+    std::fclose(f);
+
+    if (m_data.size() < 4 || std::memcmp(m_data.data(), "BARP", 4) != 0) {
+        err = "not a replay file";
+        return false;
+    }
+    m_pos = 4;
+    Cursor c{m_data, m_pos};
+
+    uint16_t version = (uint16_t)c.le(2);
+    if (version != kReplayVersion) {
+        err = "unsupported replay version " + std::to_string(version);
+        return false;
+    }
+
+    m_tickHz = (int)c.le(2);
+    GameState st;
+    st.width    = (int)c.le(2);
+    st.height   = (int)c.le(2);
+    st.bombFuse = (int)c.le(4);
+    st.maxTurns = (int)c.le(4);
+    size_t cells = (size_t)st.width * st.height;
+    if (!c.ok || m_pos + cells > m_data.size()) {
+        err = "truncated header";
+        return false;
+    }
+    st.cells.resize(cells);
+    for (size_t i = 0; i < cells; i++) st.cells[i] = (CellType)c.u8();
+
+    uint64_t players = c.var();
+    for (uint64_t i = 0; i < players && c.ok; i++) {
+        PlayerState p;
+        p.id        = (int)c.var();
+        p.x         = (int)c.var();
+        p.y         = (int)c.var();
+        p.alive     = c.u8() != 0;
+        p.bombRange = (int)c.var();
+        st.players.push_back(p);
+    }
+    if (!c.ok) {
+        err = "truncated header";
+        return false;
+    }
+
+    st.turnNumber = 0;
+    initial = std::move(st);
+    m_start = m_pos;
+    return true;
+}
+
+bool ReplayReader::next(ReplayRecord &rec) {
+    if (m_pos >= m_data.size()) return false;
+    Cursor c{m_data, m_pos};
+
+    rec.tag = (ReplayTag)c.u8();
+    switch (rec.tag) {
+        case ReplayTag::Tick: {
+            uint64_t n = c.var();
+            rec.actions.clear();
+            for (uint64_t i = 0; i < n && c.ok; i++) {
+                PlayerAction a;
+                a.playerId = (int)c.var();
+                a.type     = (ActionType)c.u8();
+                rec.actions.push_back(a);
+            }
+            break;
+        }
+        case ReplayTag::Checksum:
+            rec.turn     = (int)c.var();
+            rec.checksum = c.le(8);
+            break;
+        case ReplayTag::End:
+            rec.turn            = (int)c.var();
+            rec.result.type     = (GameResultType)c.u8();
+            rec.result.winnerId = (int)c.var() - 1;
+            rec.checksum        = c.le(8);
+            break;
+        default:
+            c.ok = false;
+    }
+
+    if (!c.ok) m_bad = true;
+    return c.ok;
+}
+
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include "engine.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace bombarena {
+
+// Match log: the initial state plus every tick's action list, enough to
+// re-run step() and get the same match back.
+//
+//   header   "BARP" u16 version, u16 tickHz, u16 width, u16 height,
+//            u32 bombFuse, u32 maxTurns, width*height cell bytes,
+//            varint playerCount, per player {varint id, varint x,
+//            varint y, u8 alive, varint bombRange}
+//   records  u8 tag, then
+//     kTick      varint count, count * {varint playerId, u8 action}
+//     kChecksum  varint turn, u64 stateChecksum
+//     kEnd       varint turn, u8 result type, varint (winnerId + 1),
+//                u64 stateChecksum
+//
+// Integers are little-endian; varints are LEB128.
+constexpr uint16_t kReplayVersion = 1;
+
+enum class ReplayTag : uint8_t { Tick = 1, Checksum = 2, End = 3 };
+
+// Order-sensitive hash of what step() evolves (players, bombs, turn)
+uint64_t stateChecksum(const GameState &st);
+
+class ReplayWriter {
+public:
+    ~ReplayWriter() { close(); }
+
+    // `initial` is the state the first tick will be applied to
+    bool open(const std::string &path, const GameState &initial, int tickHz);
+    bool isOpen() const { return m_file != nullptr; }
+
+    void tick(const std::vector<PlayerAction> &actions);
+    void checksum(const GameState &st);
+    void finish(const GameResult &res, const GameState &st);   // also closes
+    void close();
+
+private:
+    void flushBuf();
+
+    std::FILE *m_file = nullptr;
+    std::string m_buf;   // reused per record
+};
+
+struct ReplayRecord {
+    ReplayTag tag = ReplayTag::Tick;
+    std::vector<PlayerAction> actions;   // Tick
+    int turn = 0;                        // Checksum, End
+    uint64_t checksum = 0;               // Checksum, End
+    GameResult result{GameResultType::Ongoing, -1};   // End
+};
+
+class ReplayReader {
+public:
+    // Reads the whole log; on success `initial` holds the starting state
+    bool open(const std::string &path, GameState &initial, std::string &err);
+
+    // False at the end of the log or on a truncated / unknown record
+    bool next(ReplayRecord &rec);
+    bool truncated() const { return m_bad; }
+
+    int tickHz() const { return m_tickHz; }
+    // Back to the first record (after the header)
+    void rewind() { m_pos = m_start; m_bad = false; }
+
+private:
+    std::vector<uint8_t> m_data;
+    size_t m_pos = 0, m_start = 0;
+    int  m_tickHz = 5;
+    bool m_bad = false;
+};
+
+}
@@ -0,0 +1,425 @@
+#include "snapshot.hpp"
+#include "../shared/protocol.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+
+using nlohmann::json;
+
+namespace bombarena {
+
+static bool cellLess(const Bomb &a, const Bomb &b) {
+    return (a.y != b.y) ? a.y < b.y : a.x < b.x;
+}
+
+static bool samePlayer(const PlayerState &a, const PlayerState &b) {
+    return a.x == b.x && a.y == b.y && a.alive == b.alive;
+}
+
+// Minimal JSON text writer for the STATE_UPDATE hot path
+namespace {
+struct TextWriter {
+    std::string &s;
+
+    void raw(const char *t) { s.append(t); }
+    void num(long long v) {
+        char buf[24];
+        auto r = std::to_chars(buf, buf + sizeof(buf), v);
+        s.append(buf, r.ptr);
+    }
+    void unum(uint64_t v) {
+        char buf[24];
+        auto r = std::to_chars(buf, buf + sizeof(buf), v);
+        s.append(buf, r.ptr);
+    }
+    void field(const char *key, long long v) {   // ,"key":v  (key includes quotes)
+        s.push_back(',');
+        s.append(key);
+        s.push_back(':');
+        num(v);
+    }
+
+    void player(const PlayerState &p) {
+        raw("{\"id\":"); num(p.id);
+        field("\"x\"", p.x);
+        field("\"y\"", p.y);
+        raw(p.alive ? ",\"alive\":true}" : ",\"alive\":false}");
+    }
+    void bomb(const Bomb &b) {
+        raw("{\"x\":"); num(b.x);
+        field("\"y\"", b.y);
+        field("\"timer\"", b.timer);
+        field("\"ownerId\"", b.ownerId);
+        field("\"range\"", b.range);
+        s.push_back('}');
+    }
+    void cell(int x, int y) {
+        raw("{\"x\":"); num(x);
+        field("\"y\"", y);
+        s.push_back('}');
+    }
+    void sep(bool &first) {
+        if (!first) s.push_back(',');
+        first = false;
+    }
+};
+}
+
+// Worst-case lengths of one array entry, commas included
+static const size_t kPlayerText = 72, kBombText = 96, kCellText = 32, kAckText = 40,
+                    kIdText = 12;
+
+static PlayerState readPlayer(const json &p) {
+    PlayerState ps;
+    ps.id    = p["id"];
+    ps.x     = p["x"];
+    ps.y     = p["y"];
+    ps.alive = p["alive"];
+    return ps;
+}
+
+static Bomb readBomb(const json &b) {
+    Bomb bb;
+    bb.x     = b["x"];
+    bb.y     = b["y"];
+    bb.timer = b["timer"];
+    if (b.contains("ownerId")) bb.ownerId = b["ownerId"];
+    if (b.contains("range"))   bb.range   = b["range"];
+    return bb;
+}
+
+static void readCells(const json &d, const char *key,
+                      std::vector<std::pair<int,int>> &out) {
+    out.clear();
+    if (!d.contains(key)) return;
+    for (auto &e : d[key])
+        out.emplace_back(e["x"].get<int>(), e["y"].get<int>());
+}
+
+void captureSnapshot(const GameState &st, Snapshot &out) {
+    out.turn = st.turnNumber;
+    if (out.bombs.capacity() < st.bombs.capacity())
+        out.bombs.reserve(st.bombs.capacity());
+    if (out.explosions.capacity() < st.lastExplosionCells.capacity())
+        out.explosions.reserve(st.lastExplosionCells.capacity());
+    out.players = st.players;
+    out.bombs = st.bombs;
+    std::sort(out.bombs.begin(), out.bombs.end(), cellLess);
+    out.explosions = st.lastExplosionCells;
+    out.hash = st.hash;
+}
+
+uint64_t snapshotHash(const Snapshot &s) {
+    uint64_t h = 0;
+    for (auto &p : s.players) h ^= playerHashKey(p);
+    for (auto &b : s.bombs)   h ^= bombHashKey(b, s.turn);
+    return h;
+}
+
+size_t encodedSizeBound(const Snapshot &cur) {
+    // A delta can list every base bomb as removed next to every current one
+    return 192 + cur.players.capacity() * (kPlayerText + kIdText) +
+           cur.bombs.capacity() * (kBombText + kCellText) +
+           cur.explosions.capacity() * kCellText +
+           cur.acks.capacity() * kAckText;
+}
+
+static void writeKeyframe(const Snapshot &cur, TextWriter &w) {
+    w.raw(",\"key\":true,\"players\":[");
+    bool first = true;
+    for (auto &p : cur.players) { w.sep(first); w.player(p); }
+
+    w.raw("],\"bombs\":[");
+    first = true;
+    for (auto &b : cur.bombs) { w.sep(first); w.bomb(b); }
+    w.raw("]");
+}
+
+static void writeDelta(const Snapshot &base, const Snapshot &cur, TextWriter &w) {
+    const int dt = cur.turn - base.turn;
+
+    w.field("\"base\"", base.turn);
+
+    // Players only leave the list by leaving an area-of-interest view, so
+    // indices normally line up
+    w.raw(",\"players\":[");
+    bool first = true;
+    for (size_t i = 0; i < cur.players.size(); i++) {
+        const PlayerState &p = cur.players[i];
+        const PlayerState *old = nullptr;
+        if (i < base.players.size() && base.players[i].id == p.id) {
+            old = &base.players[i];
+        } else {
+            for (auto &q : base.players)
+                if (q.id == p.id) { old = &q; break; }
+        }
+        if (!old || !samePlayer(*old, p)) { w.sep(first); w.player(p); }
+    }
+    w.raw("]");
+
+    // Players that left an area-of-interest view
+    first = true;
+    for (size_t i = 0; i < base.players.size(); i++) {
+        const int id = base.players[i].id;
+        bool kept = i < cur.players.size() && cur.players[i].id == id;
+        for (size_t k = 0; !kept && k < cur.players.size(); k++)
+            kept = cur.players[k].id == id;
+        if (kept) continue;
+        w.raw(first ? ",\"players_removed\":[" : ",");
+        first = false;
+        w.num(id);
+    }
+    if (!first) w.raw("]");
+
+    // Both bomb lists are cell-sorted: one merge pass for the additions...
+    w.raw(",\"bombs_added\":[");
+    first = true;
+    size_t i = 0, j = 0;
+    while (j < cur.bombs.size()) {
+        if (i < base.bombs.size() && cellLess(base.bombs[i], cur.bombs[j])) {
+            i++;
+        } else if (i == base.bombs.size() || cellLess(cur.bombs[j], base.bombs[i])) {
+            w.sep(first); w.bomb(cur.bombs[j++]);
+        } else {
+            const Bomb &b = base.bombs[i++];
+            const Bomb &c = cur.bombs[j++];
+            bool same = b.ownerId == c.ownerId && b.range == c.range &&
+                        b.timer - dt == c.timer;
+            if (!same) { w.sep(first); w.bomb(c); }
+        }
+    }
+
+    // ...and one for the removals
+    w.raw("],\"bombs_removed\":[");
+    first = true;
+    i = j = 0;
+    while (i < base.bombs.size()) {
+        if (j < cur.bombs.size() && cellLess(cur.bombs[j], base.bombs[i])) {
+            j++;
+        } else if (j == cur.bombs.size() || cellLess(base.bombs[i], cur.bombs[j])) {
+            const Bomb &b = base.bombs[i++];
+            w.sep(first); w.cell(b.x, b.y);
+        } else {
+            i++; j++;
+        }
+    }
+    w.raw("]");
+}
+
+void encodeStateUpdate(const Snapshot *base, const Snapshot &cur, std::string &out) {
+    out.clear();
+    TextWriter w{out};
+
+    w.raw("{\"type\":");
+    w.num((int)PacketType::STATE_UPDATE);
+    w.raw(",\"data\":{\"turn\":");
+    w.num(cur.turn);
+
+    if (base) writeDelta(*base, cur, w);
+    else      writeKeyframe(cur, w);
+
+    w.raw(",\"explosions\":[");
+    bool first = true;
+    for (auto &c : cur.explosions) { w.sep(first); w.cell(c.first, c.second); }
+
+    w.raw("],\"acks\":[");
+    first = true;
+    for (auto &a : cur.acks) {
+        w.sep(first);
+        w.raw("{\"id\":"); w.num(a.first);
+        w.field("\"seq\"", a.second);
+        w.raw("}");
+    }
+    w.raw("],\"hash\":");
+    w.unum(cur.hash);
+    w.raw("}}\n");
+}
+
+// ---------------------------------------------------------------
+// Area of interest
+// ---------------------------------------------------------------
+
+// Counting sort of n entities into their buckets
+template <class Pos>
+void AoiIndex::fill(Buckets &bk, size_t n, Pos pos) {
+    const size_t nb = (size_t)m_cols * m_rows;
+    bk.start.assign(nb + 1, 0);
+    bk.idx.resize(n);
+    auto bucketOf = [&](size_t i) {
+        std::pair<int,int> c = pos(i);
+        int bx = std::clamp(c.first / kBucket, 0, m_cols - 1);
+        int by = std::clamp(c.second / kBucket, 0, m_rows - 1);
+        return (size_t)by * m_cols + bx;
+    };
+    for (size_t i = 0; i < n; i++) bk.start[bucketOf(i) + 1]++;
+    for (size_t b = 0; b < nb; b++) bk.start[b + 1] += bk.start[b];
+    // start[b] is used as bucket b's write cursor, which leaves it at the
+    // start of bucket b + 1; shifting by one restores the offsets
+    for (size_t i = 0; i < n; i++) bk.idx[bk.start[bucketOf(i)]++] = (int)i;
+    for (size_t b = nb; b > 0; b--) bk.start[b] = bk.start[b - 1];
+    bk.start[0] = 0;
+}
+
+void AoiIndex::build(const Snapshot &full, int width, int height) {
+    m_cols = std::max(1, (width + kBucket - 1) / kBucket);
+    m_rows = std::max(1, (height + kBucket - 1) / kBucket);
+    // As much room as the snapshot has, so the index stops growing with it
+    m_players.idx.reserve(full.players.capacity());
+    m_bombs.idx.reserve(full.bombs.capacity());
+    m_explosions.idx.reserve(full.explosions.capacity());
+    m_pick.reserve(std::max({full.players.capacity(), full.bombs.capacity(),
+                             full.explosions.capacity()}));
+    fill(m_players, full.players.size(),
+         [&](size_t i) { return std::make_pair(full.players[i].x, full.players[i].y); });
+    fill(m_bombs, full.bombs.size(),
+         [&](size_t i) { return std::make_pair(full.bombs[i].x, full.bombs[i].y); });
+    fill(m_explosions, full.explosions.size(),
+         [&](size_t i) { return full.explosions[i]; });
+}
+
+// Indices in the window, ascending, into m_pick
+template <class Pos>
+void AoiIndex::collect(const Buckets &bk, int cx, int cy, int radius, Pos pos) {
+    m_pick.clear();
+    if (bk.start.empty()) return;
+    int bx0 = std::clamp((cx - radius) / kBucket, 0, m_cols - 1);
+    int bx1 = std::clamp((cx + radius) / kBucket, 0, m_cols - 1);
+    int by0 = std::clamp((cy - radius) / kBucket, 0, m_rows - 1);
+    int by1 = std::clamp((cy + radius) / kBucket, 0, m_rows - 1);
+    for (int by = by0; by <= by1; by++)
+        for (int bx = bx0; bx <= bx1; bx++) {
+            size_t b = (size_t)by * m_cols + bx;
+            for (int k = bk.start[b]; k < bk.start[b + 1]; k++) {
+                std::pair<int,int> c = pos(bk.idx[k]);
+                if (std::abs(c.first - cx) <= radius && std::abs(c.second - cy) <= radius)
+                    m_pick.push_back(bk.idx[k]);
+            }
+        }
+    std::sort(m_pick.begin(), m_pick.end());
+}
+
+void AoiIndex::query(const Snapshot &full, int cx, int cy, int radius, Snapshot &out) {
+    out.turn = full.turn;
+    // Room for all of `full`, however much of it comes into view later
+    if (out.players.capacity() < full.players.capacity())
+        out.players.reserve(full.players.capacity());
+    if (out.bombs.capacity() < full.bombs.capacity())
+        out.bombs.reserve(full.bombs.capacity());
+    if (out.explosions.capacity() < full.explosions.capacity())
+        out.explosions.reserve(full.explosions.capacity());
+
+    collect(m_players, cx, cy, radius,
+            [&](int i) { return std::make_pair(full.players[i].x, full.players[i].y); });
+    out.players.clear();
+    out.hash = 0;
+    for (int i : m_pick) {
+        out.players.push_back(full.players[i]);
+        out.hash ^= playerHashKey(full.players[i]);
+    }
+
+    // full.bombs is cell-sorted, so ascending indices keep it that way
+    collect(m_bombs, cx, cy, radius,
+            [&](int i) { return std::make_pair(full.bombs[i].x, full.bombs[i].y); });
+    out.bombs.clear();
+    for (int i : m_pick) {
+        out.bombs.push_back(full.bombs[i]);
+        out.hash ^= bombHashKey(full.bombs[i], full.turn);
+    }
+
+    collect(m_explosions, cx, cy, radius, [&](int i) { return full.explosions[i]; });
+    out.explosions.clear();
+    for (int i : m_pick) out.explosions.push_back(full.explosions[i]);
+}
+
+GameState arenaFromJoin(const json &join) {
+    GameState st;
+    if (join.value("map", "classic") == "arena")
+        st = initArena(join.value("width", 11), join.value("height", 11), 0);
+    else
+        st = initTwoPlayerDefault();
+    st.players.clear();
+    st.bombs.clear();
+    st.turnNumber = 0;
+    return st;
+}
+
+Snapshot *SnapshotReceiver::find(int turn) {
+    if (turn < 0) return nullptr;
+    Snapshot &s = m_ring[turn % kSnapshotHistory];
+    return (s.turn == turn) ? &s : nullptr;
+}
+
+bool SnapshotReceiver::apply(const json &d, GameState &st) {
+    int turn = d.value("turn", -1);
+    if (turn < 0) return false;
+    // Over UDP, or mixed UDP / TCP, an older turn can arrive after a newer
+    // one; it has nothing to add
+    if (turn <= m_lastTurn) return true;
+
+    Snapshot next;
+    next.turn = turn;
+
+    if (d.contains("base")) {
+        const Snapshot *base = find(d["base"].get<int>());
+        if (!base) return false;
+        const int dt = turn - base->turn;
+
+        next.players = base->players;
+        for (auto &jp : d["players"]) {
+            PlayerState ps = readPlayer(jp);
+            auto it = std::find_if(next.players.begin(), next.players.end(),
+                                   [&](const PlayerState &q) { return q.id == ps.id; });
+            if (it != next.players.end()) *it = ps;
+            else next.players.push_back(ps);
+        }
+        if (d.contains("players_removed"))
+            for (auto &jid : d["players_removed"]) {
+                int id = jid.get<int>();
+                next.players.erase(std::remove_if(next.players.begin(), next.players.end(),
+                                                  [id](const PlayerState &q) { return q.id == id; }),
+                                   next.players.end());
+            }
+
+        std::vector<std::pair<int,int>> gone;
+        readCells(d, "bombs_removed", gone);
+        for (auto &jb : d["bombs_added"]) {
+            Bomb b = readBomb(jb);
+            gone.emplace_back(b.x, b.y);   // replaced
+        }
+        for (const Bomb &b : base->bombs) {
+            if (std::find(gone.begin(), gone.end(), std::make_pair(b.x, b.y)) != gone.end())
+                continue;
+            Bomb nb = b;
+            nb.timer -= dt;
+            next.bombs.push_back(nb);
+        }
+        for (auto &jb : d["bombs_added"])
+            next.bombs.push_back(readBomb(jb));
+    } else {
+        for (auto &jp : d["players"]) next.players.push_back(readPlayer(jp));
+        for (auto &jb : d["bombs"])   next.bombs.push_back(readBomb(jb));
+    }
+
+    std::sort(next.bombs.begin(), next.bombs.end(), cellLess);
+    readCells(d, "explosions", next.explosions);
+
+    // Older servers send no hash
+    next.hash = snapshotHash(next);
+    if (d.contains("hash") && d["hash"].get<uint64_t>() != next.hash) {
+        m_desyncs++;
+        return false;
+    }
+
+    st.turnNumber = turn;
+    st.players = next.players;
+    st.bombs = next.bombs;
+    st.lastExplosionCells = next.explosions;
+    st.hash = next.hash;
+
+    m_ring[turn % kSnapshotHistory] = std::move(next);
+    m_lastTurn = turn;
+    return true;
+}
+
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include "engine.hpp"
+#include "../shared/json.hpp"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bombarena {
+
+// What clients see of one turn. Bombs are kept sorted by cell so two
+// snapshots can be diffed in one merge pass.
+struct Snapshot {
+    int turn = -1;
+    std::vector<PlayerState> players;
+    std::vector<Bomb> bombs;
+    std::vector<std::pair<int,int>> explosions;
+
+    // Zobrist hash of players and bombs as listed (GameState::hash for a
+    // whole turn); lets the receiver check what it rebuilt
+    uint64_t hash = 0;
+
+    // Server side: highest input seq applied per player id, so clients
+    // can drop the inputs they predicted. Not part of the game state.
+    std::vector<std::pair<int, uint32_t>> acks;
+};
+
+// Turns kept on both ends; a delta can only be built against one of these
+constexpr int kSnapshotHistory = 32;
+
+// Copies the turn into `out`, reusing its storage. Capacities follow the
+// state's own reservations so a warmed-up slot never reallocates.
+void captureSnapshot(const GameState &st, Snapshot &out);
+
+// Hash of a snapshot's players and bombs, from scratch
+uint64_t snapshotHash(const Snapshot &s);
+
+// STATE_UPDATE payloads.
+//   keyframe: {turn, key:true, players, bombs, explosions, acks, hash}   (the full state)
+//   delta:    {turn, base, players (changed only), [players_removed],
+//              bombs_added, bombs_removed, explosions, acks, hash}
+// acks is [{id, seq}] and is complete for the snapshot it came with.
+// hash is Snapshot::hash of the state the update describes.
+// Bombs present in both with the expected countdown are omitted; the
+// receiver ticks their timers down itself. players_removed (ids) only
+// appears when a player left the sender's area of interest.
+//
+// Writes the whole packet line into `out` (base == nullptr: keyframe).
+// The text is produced directly, with no JSON tree in between; once `out`
+// has encodedSizeBound() capacity this does not allocate.
+void encodeStateUpdate(const Snapshot *base, const Snapshot &cur, std::string &out);
+size_t encodedSizeBound(const Snapshot &cur);
+
+// Area of interest on large maps: entities bucketed into fixed-size grid
+// cells once per turn, so cutting one client's window out of the turn
+// only looks at the buckets the window overlaps.
+class AoiIndex {
+public:
+    static constexpr int kBucket = 16;   // cells per bucket side
+
+    // Indexes `full`, which must stay unchanged until the last query()
+    void build(const Snapshot &full, int width, int height);
+
+    // Players, bombs and explosions of `full` within `radius` cells
+    // (Chebyshev) of (cx, cy), in the same order as in `full`, and their
+    // hash. `out` keeps its storage; turn is copied, acks are left to
+    // the caller.
+    void query(const Snapshot &full, int cx, int cy, int radius, Snapshot &out);
+
+private:
+    // One CSR list per entity kind: bucket b holds idx[start[b]..start[b+1])
+    struct Buckets {
+        std::vector<int> start;
+        std::vector<int> idx;
+    };
+    template <class Pos>
+    void fill(Buckets &bk, size_t n, Pos pos);
+    template <class Pos>
+    void collect(const Buckets &bk, int cx, int cy, int radius, Pos pos);
+
+    int m_cols = 0, m_rows = 0;
+    Buckets m_players, m_bombs, m_explosions;
+    std::vector<int> m_pick;   // query scratch
+};
+
+// Client side: the empty map a JOIN_GAME describes (map, width, height)
+GameState arenaFromJoin(const nlohmann::json &join);
+
+// Client side: rebuilds full snapshots from keyframes and deltas.
+class SnapshotReceiver {
+public:
+    // Applies a STATE_UPDATE to `st`. Returns false if it is a delta against
+    // a turn we no longer have, or the result does not match the sender's
+    // hash (nothing is applied then); the caller should ask for a keyframe.
+    // Updates not newer than lastTurn() are ignored (and return true).
+    bool apply(const nlohmann::json &d, GameState &st);
+
+    int lastTurn() const { return m_lastTurn; }
+    long desyncs() const { return m_desyncs; }   // hash mismatches so far
+
+private:
+    Snapshot *find(int turn);
+
+    std::array<Snapshot, kSnapshotHistory> m_ring;
+    int m_lastTurn = -1;
+    long m_desyncs = 0;
+};
+
+}
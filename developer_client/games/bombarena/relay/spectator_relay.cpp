@@ -0,0 +1,387 @@
+// Spectator relay: one subscription to a game server's --spectator-port,
+// fanned out to any number of watchers, so the game server's cost does
+// not grow with the audience.
+//
+//   spectator_relay --upstream PORT --port PORT [--host 127.0.0.1]
+//                   [--delay SECONDS] [--max-spectators N]
+//
+// Spectators connect the way players do (the CLI and GUI clients work
+// unchanged) and get JOIN_GAME with player_id -1, PLAYER_START_GAME, the
+// STATE_UPDATEs and GAME_END; anything they send except a keyframe
+// request is ignored. Every turn is encoded at most twice, as a delta
+// against the turn released before it and as a keyframe, and those two
+// buffers are shared by all spectators' send queues. --delay holds every
+// packet back that long, so watchers cannot feed players live positions.
+// The relay exits once GAME_END has gone out (or the game server is gone).
+
+#include "../shared/tcp.hpp"
+#include "../shared/packet.hpp"
+#include "../engine/engine.hpp"
+#include "../engine/snapshot.hpp"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace bombarena;
+
+// accept() failed. Out of descriptors or memory it fails again at once;
+// give the connections in use a moment instead of spinning.
+static void acceptBackoff() {
+    if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+}
+
+static int64_t monotonicNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+struct RelayOptions {
+    std::string host = "127.0.0.1";
+    int upstreamPort = 0;      // game server --spectator-port
+    int port = 0;              // where spectators connect
+    double delaySec = 0;
+    int maxSpectators = 1000;
+};
+
+class SpectatorRelay {
+public:
+    explicit SpectatorRelay(const RelayOptions &o) : m_opts(o) {}
+    ~SpectatorRelay() {
+        if (m_listenSock >= 0) close(m_listenSock);
+    }
+
+    int run();
+
+private:
+    // What came from upstream, waiting for its release time
+    struct Item {
+        enum Kind { Start, State, End } kind = State;
+        int64_t dueNs = 0;
+        Snapshot snap;         // State
+        SharedBuffer line;     // Start, End (null End: upstream lost)
+    };
+
+    struct Spectator {
+        int id = 0;
+        std::shared_ptr<TCPConnection> conn;
+        std::shared_ptr<SendQueue> out;
+        bool active = true;
+        bool wantKey = true;   // has no baseline for the next delta
+    };
+
+    bool connectUpstream();
+    bool listenSpectators();
+    void upstreamLoop();
+    void acceptLoop();
+    void spectatorThread(std::shared_ptr<TCPConnection> conn, int id);
+    void enqueue(Item item);
+    void release(Item &item);
+
+    RelayOptions m_opts;
+    int64_t m_delayNs = 0;
+
+    // Upstream thread
+    std::shared_ptr<TCPConnection> m_upstream;
+    SnapshotReceiver m_rx;
+    GameState m_state;
+    int m_lastQueued = -1;   // stale updates apply as no-ops; not queued again
+
+    int m_listenSock = -1;
+
+    std::mutex m_queueMutex;
+    std::condition_variable m_queueCv;
+    std::deque<Item> m_queue;
+
+    // Release thread; the snapshot deltas are made against
+    Snapshot m_prev;
+
+    std::mutex m_mutex;                  // guards everything below
+    std::vector<Spectator> m_spectators;
+    SharedBuffer m_join;                 // JOIN_GAME as sent to spectators
+    SharedBuffer m_start;                // once released
+    int m_nextId = 1;
+
+    std::atomic<bool> m_running{true};
+
+    // Totals, release thread
+    long m_turns = 0, m_keyframes = 0, m_deltas = 0;
+    size_t m_peak = 0;
+};
+
+bool SpectatorRelay::connectUpstream() {
+    m_upstream = std::make_shared<TCPConnection>();
+    if (!m_upstream->connectToServer(m_opts.host, m_opts.upstreamPort))
+        return false;
+
+    // The game server opens with JOIN_GAME: the map and rules
+    Packet p;
+    if (!m_upstream->recvPacket(p) || p.type != PacketType::JOIN_GAME) {
+        std::cerr << "[Relay] Upstream did not accept the subscription\n";
+        return false;
+    }
+    m_state = arenaFromJoin(p.data);
+    p.data["player_id"] = -1;
+    p.data["spectator"] = true;
+    m_join = encodePacket(p);
+    std::cout << "[Relay] Subscribed to " << m_opts.host << ":" << m_opts.upstreamPort
+              << " (" << m_state.width << "x" << m_state.height << ")\n";
+    return true;
+}
+
+bool SpectatorRelay::listenSpectators() {
+    m_listenSock = socket(AF_INET, SOCK_STREAM, 0);
+    if (m_listenSock < 0) {
+        perror("socket");
+        return false;
+    }
+    int opt = 1;
+    setsockopt(m_listenSock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(m_opts.port);
+    if (bind(m_listenSock, (sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        return false;
+    }
+    if (listen(m_listenSock, 64) < 0) {
+        perror("listen");
+        return false;
+    }
+    std::cout << "[Relay] Spectators on port " << m_opts.port << "\n";
+    return true;
+}
+
+int SpectatorRelay::run() {
+    m_delayNs = (int64_t)(m_opts.delaySec * 1e9);
+    if (!connectUpstream() || !listenSpectators())
+        return 1;
+
+    std::thread(&SpectatorRelay::upstreamLoop, this).detach();
+    std::thread(&SpectatorRelay::acceptLoop, this).detach();
+
+    // Release thread: hands each item out once its delay has passed
+    while (true) {
+        Item item;
+        {
+            std::unique_lock<std::mutex> lk(m_queueMutex);
+            while (true) {
+                if (m_queue.empty()) {
+                    m_queueCv.wait(lk);
+                    continue;
+                }
+                int64_t wait = m_queue.front().dueNs - monotonicNs();
+                if (wait <= 0) break;
+                m_queueCv.wait_for(lk, std::chrono::nanoseconds(wait));
+            }
+            item = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+
+        release(item);
+        if (item.kind == Item::End) break;
+    }
+
+    m_running = false;
+    std::vector<Spectator> done;
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        done.swap(m_spectators);
+    }
+    for (auto &s : done) s.out->close();
+    std::cout << "[Relay] " << m_turns << " turns to at most " << m_peak << " spectators, "
+              << m_deltas << " delta / " << m_keyframes << " keyframe encodings\n";
+    return 0;   // the queues flush as `done` goes
+}
+
+void SpectatorRelay::enqueue(Item item) {
+    item.dueNs = monotonicNs() + m_delayNs;
+    {
+        std::lock_guard<std::mutex> lk(m_queueMutex);
+        m_queue.push_back(std::move(item));
+    }
+    m_queueCv.notify_one();
+}
+
+// Keeps acknowledging like a client, so the game server keeps sending
+// deltas; the relay's own delay does not hold the acks back
+void SpectatorRelay::upstreamLoop() {
+    while (true) {
+        Packet p;
+        if (!m_upstream->recvPacket(p)) {
+            std::cout << "[Relay] Upstream closed\n";
+            enqueue(Item{Item::End, 0, {}, nullptr});
+            return;
+        }
+
+        switch (p.type) {
+            case PacketType::PLAYER_START_GAME:
+                enqueue(Item{Item::Start, 0, {}, encodePacket(p)});
+                break;
+
+            case PacketType::STATE_UPDATE: {
+                bool applied = m_rx.apply(p.data, m_state);
+
+                Packet ack;
+                ack.type = PacketType::STATE_ACK;
+                ack.data["turn"] = m_rx.lastTurn();
+                if (!applied) ack.data["keyframe"] = true;
+                m_upstream->sendPacket(ack);
+
+                if (applied && m_rx.lastTurn() > m_lastQueued) {
+                    Item it;
+                    it.kind = Item::State;
+                    captureSnapshot(m_state, it.snap);
+                    m_lastQueued = it.snap.turn;
+                    enqueue(std::move(it));
+                }
+                break;
+            }
+
+            case PacketType::GAME_END:
+                enqueue(Item{Item::End, 0, {}, encodePacket(p)});
+                return;
+
+            default:
+                break;
+        }
+    }
+}
+
+void SpectatorRelay::release(Item &item) {
+    std::lock_guard<std::mutex> lk(m_mutex);
+    m_spectators.erase(std::remove_if(m_spectators.begin(), m_spectators.end(),
+                                      [](const Spectator &s) { return !s.active; }),
+                       m_spectators.end());
+    m_peak = std::max(m_peak, m_spectators.size());
+
+    if (item.kind != Item::State) {
+        if (item.kind == Item::Start) m_start = item.line;
+        if (item.line)
+            for (auto &s : m_spectators) s.out->push(item.line);
+        return;
+    }
+
+    // Each encoding is made once, and only if someone needs it
+    SharedBuffer delta, key;
+    for (auto &s : m_spectators) {
+        const bool full = s.wantKey || m_prev.turn < 0;
+        SharedBuffer &line = full ? key : delta;
+        if (!line) {
+            auto buf = std::make_shared<std::string>();
+            buf->reserve(encodedSizeBound(item.snap));
+            encodeStateUpdate(full ? nullptr : &m_prev, item.snap, *buf);
+            line = std::move(buf);
+            (full ? m_keyframes : m_deltas)++;
+        }
+        // A dropped backlog means this spectator's baseline is gone
+        if (!s.out->push(line)) s.wantKey = true;
+        else if (full)          s.wantKey = false;
+    }
+    m_prev = std::move(item.snap);
+    m_turns++;
+}
+
+void SpectatorRelay::acceptLoop() {
+    while (m_running) {
+        sockaddr_in cli{};
+        socklen_t len = sizeof(cli);
+        int csock = accept(m_listenSock, (sockaddr *)&cli, &len);
+        if (csock < 0) {
+            if (!m_running) break;
+            acceptBackoff();
+            continue;
+        }
+
+        auto conn = std::make_shared<TCPConnection>(csock);
+        int id;
+        {
+            std::lock_guard<std::mutex> lk(m_mutex);
+            size_t live = std::count_if(m_spectators.begin(), m_spectators.end(),
+                                        [](const Spectator &s) { return s.active; });
+            if ((int)live >= m_opts.maxSpectators)
+                continue;   // conn's destructor closes the socket
+
+            Spectator s;
+            s.id = id = m_nextId++;
+            s.conn = conn;
+            s.out = std::make_shared<SendQueue>(conn);
+            s.out->push(m_join);
+            if (m_start) s.out->push(m_start);
+            m_spectators.push_back(std::move(s));
+        }
+        std::thread(&SpectatorRelay::spectatorThread, this, conn, id).detach();
+    }
+}
+
+void SpectatorRelay::spectatorThread(std::shared_ptr<TCPConnection> conn, int id) {
+    while (true) {
+        Packet p;
+        if (!conn->recvPacket(p)) break;
+        if (p.type != PacketType::STATE_ACK || !p.data.value("keyframe", false))
+            continue;
+
+        std::lock_guard<std::mutex> lk(m_mutex);
+        for (auto &s : m_spectators)
+            if (s.id == id) s.wantKey = true;
+    }
+
+    std::lock_guard<std::mutex> lk(m_mutex);
+    for (auto &s : m_spectators)
+        if (s.id == id) {
+            s.active = false;
+            s.out->close();
+        }
+}
+
+int main(int argc, char **argv) {
+    RelayOptions o;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string a = argv[i], v = argv[i + 1];
+        try {
+            if (a == "--host")                o.host = v;
+            else if (a == "--upstream")       o.upstreamPort = std::stoi(v);
+            else if (a == "--port")           o.port = std::stoi(v);
+            else if (a == "--delay")          o.delaySec = std::stod(v);
+            else if (a == "--max-spectators") o.maxSpectators = std::stoi(v);
+            else {
+                std::cerr << "unknown option " << a << "\n";
+                return 1;
+            }
+        } catch (std::exception &) {
+            std::cerr << "bad value for " << a << ": " << v << "\n";
+            return 1;
+        }
+    }
+
+    if (o.upstreamPort <= 0 || o.port < 10000 || o.port > 65535) {
+        std::cerr << "Usage: spectator_relay --upstream PORT --port PORT (>= 10000)"
+                     " [--host H] [--delay S] [--max-spectators N]\n";
+        return 1;
+    }
+    if (o.delaySec < 0 || o.delaySec > 600 || o.maxSpectators < 1) {
+        std::cerr << "--delay must be 0..600 s and --max-spectators >= 1\n";
+        return 1;
+    }
+
+    SpectatorRelay relay(o);
+    return relay.run();
+}
@@ -0,0 +1,73 @@
+#include "ai_pool.hpp"
+
+#include <algorithm>
+#include <time.h>
+
+using namespace bombarena;
+
+static int64_t monotonicNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+AiPool::AiPool(int workers, Submit submit) : m_submit(std::move(submit)) {
+    for (int i = 0; i < std::max(1, workers); i++) {
+        m_workers.push_back(std::make_unique<Worker>());
+        m_workers.back()->planner = AiPlanner(0x9e3779b97f4a7c15ull * (i + 1));
+    }
+}
+
+AiPool::~AiPool() {
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    for (auto &w : m_workers)
+        if (w->thread.joinable()) w->thread.join();
+}
+
+void AiPool::addPlayer(int playerId) {
+    Worker &w = *m_workers[m_nextWorker++ % m_workers.size()];
+    w.players.push_back(playerId);
+    if (!w.thread.joinable())
+        w.thread = std::thread(&AiPool::run, this, std::ref(w));
+}
+
+void AiPool::publish(const GameState &st, int64_t deadlineNs) {
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        // The map never changes during a match
+        if (m_gen == 0) m_latest = st;
+        else            copyDynamicState(m_latest, st);
+        m_deadlineNs = deadlineNs;
+        m_gen++;
+    }
+    m_cv.notify_all();
+}
+
+void AiPool::run(Worker &w) {
+    uint64_t seen = 0;
+    while (true) {
+        int64_t deadline;
+        {
+            std::unique_lock<std::mutex> lk(m_mutex);
+            m_cv.wait(lk, [&] { return m_stop || m_gen != seen; });
+            if (m_stop) return;
+            if (seen == 0) w.view = m_latest;
+            else           copyDynamicState(w.view, m_latest);
+            seen = m_gen;
+            deadline = m_deadlineNs;
+        }
+
+        // Split what is left of the tick between this worker's players
+        for (size_t i = 0; i < w.players.size(); i++) {
+            int64_t left = deadline - monotonicNs();
+            int64_t budget = std::max(left / (int64_t)(w.players.size() - i), kMinBudgetNs);
+            ActionType act = w.planner.choose(w.view, w.players[i], budget, kMaxRollouts);
+            m_rollouts.fetch_add(w.planner.lastRollouts(), std::memory_order_relaxed);
+            m_submit(w.players[i], act);
+        }
+    }
+}
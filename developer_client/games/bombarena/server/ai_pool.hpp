@@ -0,0 +1,62 @@
+#pragma once
+#include "../engine/engine.hpp"
+#include "../engine/ai.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Worker threads that play the server's AI players. After each tick the
+// tick thread publish()es the new state and the deadline for the next
+// tick; every worker plans its share of the AI players within that time
+// and hands each move to `submit`. A player always belongs to the same
+// worker, so each player's input has a single producer.
+class AiPool {
+public:
+    using Submit = std::function<void(int playerId, bombarena::ActionType act)>;
+
+    AiPool(int workers, Submit submit);
+    ~AiPool();   // stops and joins the workers
+
+    // Before the first publish()
+    void addPlayer(int playerId);
+
+    // Tick thread. `deadlineNs` is CLOCK_MONOTONIC time by which moves
+    // should be in.
+    void publish(const bombarena::GameState &st, int64_t deadlineNs);
+
+    long rollouts() const { return m_rollouts.load(std::memory_order_relaxed); }
+
+private:
+    struct Worker {
+        std::thread thread;
+        std::vector<int> players;
+        bombarena::AiPlanner planner;
+        bombarena::GameState view;   // this worker's copy of the published state
+    };
+
+    void run(Worker &w);
+
+    // Still searched a little when the tick is already over
+    static constexpr int64_t kMinBudgetNs = 1000000;
+    // Past this the choice hardly changes; stop instead of burning the tick
+    static constexpr long kMaxRollouts = 2000;
+
+    Submit m_submit;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    size_t m_nextWorker = 0;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bombarena::GameState m_latest;   // guarded by m_mutex
+    uint64_t m_gen = 0;
+    int64_t m_deadlineNs = 0;
+    bool m_stop = false;
+
+    std::atomic<long> m_rollouts{0};
+};
@@ -1,47 +1,94 @@
 #include "game_server.hpp"
 
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <cerrno>
+#include <cmath>
 #include <iostream>
 #include <thread>
+#include <algorithm>
 
 using namespace bombarena;
 
-BombArenaServer::BombArenaServer(int port)
-    : m_port(port)
+static int64_t monotonicNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// accept() failed. Out of descriptors or memory it fails again at once;
+// give the connections in use a moment instead of spinning.
+static void acceptBackoff() {
+    if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+}
+
+BombArenaServer::BombArenaServer(const ServerOptions &opts)
+    : m_port(opts.port),
+      m_lobbyHost(opts.lobbyHost), m_lobbyPort(opts.lobbyPort), m_roomId(opts.roomId),
+      m_lobbyToken(opts.lobbyToken), m_seatTokens(opts.seats),
+      m_spectatorPort(opts.spectatorPort),
+      m_maxPlayers(opts.maxPlayers), m_width(opts.width), m_height(opts.height),
+      m_aiFill(opts.aiFill), m_aiThreads(opts.aiThreads),
+      m_udpOffered(opts.udp), m_udpLossIn(opts.udpLoss), m_udpLossOut(opts.udpLoss),
+      m_tickHz(opts.tickHz), m_recordPath(opts.recordPath),
+      m_aoiRadius(opts.aoiRadius)
 {
+    // Ids run 1..m_maxPlayers
+    m_inputs.resize(m_maxPlayers + 1);
+    for (auto &slot : m_inputs)
+        slot = std::make_unique<InputSlot>();
+    m_acts.reserve(m_maxPlayers);
+    m_built.reserve(m_maxPlayers + kMaxRelays);
+    m_encodePool.reserve(kEncodeSlack * (m_maxPlayers + kMaxRelays));
+    for (auto &h : m_history)
+        h.acks.reserve(m_maxPlayers + 1);
 }
 
 BombArenaServer::~BombArenaServer() {
     closeListenSocket();
+    if (m_udpSock >= 0) close(m_udpSock);
+    if (m_spectatorSock >= 0) close(m_spectatorSock);
 }
 
-bool BombArenaServer::setupListenSocket() {
-    m_listenSock = socket(AF_INET, SOCK_STREAM, 0);
-    if (m_listenSock < 0) {
+int BombArenaServer::openListenSocket(int port) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
         perror("socket");
-        return false;
+        return -1;
     }
 
     int opt = 1;
-    setsockopt(m_listenSock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
 
     sockaddr_in addr{};
     addr.sin_family = AF_INET;
     addr.sin_addr.s_addr = INADDR_ANY;
-    addr.sin_port = htons(m_port);
+    addr.sin_port = htons(port);
 
-    if (bind(m_listenSock, (sockaddr *)&addr, sizeof(addr)) < 0) {
+    if (bind(sock, (sockaddr *)&addr, sizeof(addr)) < 0) {
         perror("bind");
-        return false;
+        close(sock);
+        return -1;
     }
 
-    if (listen(m_listenSock, 8) < 0) {
+    if (listen(sock, 8) < 0) {
         perror("listen");
-        return false;
+        close(sock);
+        return -1;
     }
+    return sock;
+}
+
+bool BombArenaServer::setupListenSocket() {
+    m_listenSock = openListenSocket(m_port);
+    if (m_listenSock < 0)
+        return false;
 
     std::cout << "[Server] Listening on port " << m_port << "\n";
     return true;
@@ -59,14 +106,73 @@ void BombArenaServer::run() {
         return;
 
     // Initialize arena
-    m_state = initTwoPlayerDefault();
-    m_state.players.clear();
-    m_state.bombs.clear();
-    m_state.lastExplosionCells.clear();
-    m_state.turnNumber = 0;
+    m_state = buildArena({});
+    m_mapWidth = m_state.width;
+    m_mapHeight = m_state.height;
+
+    if (m_udpOffered) {
+        m_udpSock = udpBind(m_port);
+        if (m_udpSock < 0)
+            std::cout << "[Server] UDP unavailable, TCP only.\n";
+        else if (m_udpLossIn.probability() > 0)
+            std::cout << "[Server] Injecting " << m_udpLossIn.probability() * 100
+                      << "% UDP loss each way.\n";
+    }
+
+    if (m_spectatorPort) {
+        m_spectatorSock = openListenSocket(m_spectatorPort);
+        if (m_spectatorSock < 0)
+            std::cout << "[Server] Spectator port unavailable, no relays.\n";
+        else
+            std::cout << "[Server] Spectator relays on port " << m_spectatorPort << "\n";
+    }
+
+    connectLobby();
 
     acceptLoop();
+
+    // The match is over
+    for (std::thread *t : {&m_tickThread, &m_udpThread, &m_spectatorThread, &m_monitorThread})
+        if (t->joinable()) t->join();
+    drainClients();
+    m_lobbyOut.reset();   // writes out the result
     closeListenSocket();
+    std::cout << "[Server] Shut down.\n";
+}
+
+// Tick thread, after the last tick. shutdown() on a listening socket
+// fails a blocked accept() with EINVAL; the sockets are closed later.
+void BombArenaServer::stopAccepting() {
+    m_running = false;
+    if (m_listenSock >= 0) shutdown(m_listenSock, SHUT_RDWR);
+    if (m_spectatorSock >= 0) shutdown(m_spectatorSock, SHUT_RDWR);
+}
+
+// Main thread, once the tick, UDP and accept threads are gone
+void BombArenaServer::drainClients() {
+    std::vector<std::shared_ptr<SendQueue>> outs;
+    std::vector<std::shared_ptr<TCPConnection>> conns;
+    {
+        std::lock_guard<std::mutex> lk(m_clientsMutex);
+        timeval tv{kDrainMs / 1000, (kDrainMs % 1000) * 1000};
+        for (auto &c : m_clients) {
+            // A peer that stopped reading cannot hold the shutdown up
+            setsockopt(c.conn->fd(), SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+            conns.push_back(c.conn);
+            if (c.out) outs.push_back(std::move(c.out));
+            c.active = false;
+        }
+    }
+    // Each queue's destructor writes out the rest and joins its writer
+    for (auto &o : outs) o->close();
+    outs.clear();
+
+    for (auto &c : conns)
+        shutdown(c->fd(), SHUT_RDWR);
+    for (int waited = 0; m_clientThreads > 0 && waited < kDrainMs; waited += 10)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    if (m_clientThreads > 0)
+        std::cout << "[Server] " << m_clientThreads << " client thread(s) still busy.\n";
 }
 
 // ========================================================
@@ -74,44 +180,156 @@ void BombArenaServer::run() {
 // ========================================================
 
 void BombArenaServer::acceptLoop() {
-    std::thread tick(&BombArenaServer::tickLoop, this);
-    tick.detach();
+    m_tickThread = std::thread(&BombArenaServer::tickLoop, this);
+    if (m_udpSock >= 0)
+        m_udpThread = std::thread(&BombArenaServer::udpLoop, this);
+    if (m_spectatorSock >= 0)
+        m_spectatorThread = std::thread(&BombArenaServer::spectatorAcceptLoop, this);
+    m_monitorThread = std::thread(&BombArenaServer::monitorLoop, this);
 
     while (m_running) {
 
         sockaddr_in cli{};
         socklen_t len = sizeof(cli);
         int csock = accept(m_listenSock, (sockaddr *)&cli, &len);
-        if (csock < 0) continue;
+        if (csock < 0) {
+            if (m_running) acceptBackoff();
+            continue;
+        }
+        if (!m_running) {
+            close(csock);
+            break;
+        }
 
-        // Enforce max players = 3
+        // A running match only takes its own players back (RESUME_GAME)
+        if (m_gameStarted) {
+            timeval tv{kResumeWaitMs / 1000, 0};
+            setsockopt(csock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            auto conn = std::make_shared<TCPConnection>(csock);
+            m_clientThreads++;
+            std::thread(&BombArenaServer::clientThread, this, conn, 0).detach();
+            continue;
+        }
+
+        int playerId;
+        auto conn = std::make_shared<TCPConnection>(csock);
         {
             std::lock_guard<std::mutex> lk(m_clientsMutex);
-            if ((int)m_clients.size() >= m_maxPlayers) {
+            // Enforce max players
+            playerId = usedSlots() < m_maxPlayers ? freePlayerId() : 0;
+            if (!playerId) {
                 std::cout << "[Server] Room full, rejecting.\n";
-                close(csock);
                 continue;
             }
+            inputSlot(playerId)->tcpProducer = conn.get();
+            ClientInfo c{playerId, conn, true, std::make_shared<SendQueue>(conn)};
+            c.session = m_tokenRng() | 1;
+            if (m_udpSock >= 0) c.udpToken = m_tokenRng() | 1;   // 0 = no UDP
+
+            // Send JOIN signal (queued first so it precedes any broadcast)
+            c.out->push(encodePacket(joinPacket(playerId, c.session, c.udpToken)));
+            m_clients.push_back(std::move(c));
         }
 
-        int playerId = m_nextPlayerId++;
-        auto conn = std::make_shared<TCPConnection>(csock);
+        std::cout << "[Server] Player #" << playerId << " connected.\n";
 
-        {
-            std::lock_guard<std::mutex> lk(m_clientsMutex);
-            m_clients.push_back(ClientInfo{playerId, conn, true});
+        m_clientThreads++;
+        std::thread(&BombArenaServer::clientThread, this, conn, playerId).detach();
+    }
+}
+
+Packet BombArenaServer::joinPacket(int playerId, uint64_t session, uint64_t udpToken) const {
+    Packet j;
+    j.type = PacketType::JOIN_GAME;
+    j.data["player_id"] = playerId;
+    j.data["max_players"] = m_maxPlayers;
+    // What a predicting client needs to run the rules locally
+    j.data["tick_ms"] = 1000.0 / m_tickHz;
+    j.data["bomb_fuse"] = turnsFor(kBombFuseSeconds);
+    j.data["map"] = m_width ? "arena" : "classic";
+    j.data["width"] = m_mapWidth;
+    j.data["height"] = m_mapHeight;
+    if (m_aoiRadius > 0) j.data["aoi"] = m_aoiRadius;
+    if (session) j.data["session"] = session;
+    if (udpToken) {
+        j.data["udp_port"] = m_port;
+        j.data["udp_token"] = udpToken;
+    }
+    return j;
+}
+
+int BombArenaServer::usedSlots() const {
+    int n = (int)m_aiIds.size();
+    for (auto &c : m_clients)
+        if (c.playerId > 0) n++;
+    return n;
+}
+
+int BombArenaServer::freePlayerId() const {
+    for (int id = 1; id <= m_maxPlayers; id++) {
+        bool taken = std::find(m_aiIds.begin(), m_aiIds.end(), id) != m_aiIds.end() ||
+                     std::any_of(m_clients.begin(), m_clients.end(),
+                                 [&](const ClientInfo &c) { return c.playerId == id; });
+        if (!taken) return id;
+    }
+    return 0;
+}
+
+BombArenaServer::InputSlot *BombArenaServer::inputSlot(int playerId) {
+    if (playerId <= 0 || playerId >= (int)m_inputs.size()) return nullptr;
+    return m_inputs[playerId].get();
+}
+
+// ========================================================
+// Spectator relays
+// ========================================================
+
+void BombArenaServer::spectatorAcceptLoop() {
+    while (m_running) {
+        sockaddr_in cli{};
+        socklen_t len = sizeof(cli);
+        int csock = accept(m_spectatorSock, (sockaddr *)&cli, &len);
+        if (csock < 0) {
+            if (m_running) acceptBackoff();
+            continue;
         }
 
-        // Send JOIN signal
-        Packet j;
-        j.type = PacketType::JOIN_GAME;
-        j.data["player_id"] = playerId;
-        j.data["max_players"] = m_maxPlayers;
-        conn->sendPacket(j);
+        if (!m_running) {
+            close(csock);
+            break;
+        }
 
-        std::cout << "[Server] Player #" << playerId << " connected.\n";
+        auto conn = std::make_shared<TCPConnection>(csock);
+        auto out  = std::make_shared<SendQueue>(conn);
+        int relayId;
+        {
+            std::lock_guard<std::mutex> lk(m_clientsMutex);
+            int relays = 0;
+            for (auto &c : m_clients)
+                if (c.active && c.playerId < 0) relays++;
+            if (relays >= kMaxRelays) {
+                std::cout << "[Server] Relay limit reached, rejecting.\n";
+                continue;   // conn's destructor closes the socket
+            }
+            relayId = m_nextRelayId--;
+
+            // The map a spectator needs to draw; START if it missed it.
+            // Queued under the lock so no broadcast can get in between.
+            Packet j = joinPacket(-1, 0, 0);
+            j.data["spectator"] = true;
+            j.data.erase("aoi");
+            out->push(encodePacket(j));
+            if (m_gameStarted) {
+                Packet s;
+                s.type = PacketType::PLAYER_START_GAME;
+                out->push(encodePacket(s));
+            }
+            m_clients.push_back(ClientInfo{relayId, conn, true, out});
+        }
 
-        std::thread(&BombArenaServer::clientThread, this, conn, playerId).detach();
+        std::cout << "[Server] Spectator relay " << -relayId << " connected.\n";
+        m_clientThreads++;
+        std::thread(&BombArenaServer::clientThread, this, conn, relayId).detach();
     }
 }
 
@@ -119,40 +337,93 @@ void BombArenaServer::acceptLoop() {
 // Per-client thread
 // ========================================================
 
+static ActionType parseAction(const std::string &s) {
+    if (s == "w") return ActionType::MoveUp;
+    if (s == "s") return ActionType::MoveDown;
+    if (s == "a") return ActionType::MoveLeft;
+    if (s == "d") return ActionType::MoveRight;
+    if (s == "b") return ActionType::PlaceBomb;
+    return ActionType::Stay;
+}
+
+// playerId 0: a connection to a running match that has to resume first
 void BombArenaServer::clientThread(std::shared_ptr<TCPConnection> conn, int playerId) {
+    struct Done {
+        std::atomic<int> &n;
+        ~Done() { n--; }
+    } done{m_clientThreads};
 
     while (m_running) {
         Packet p;
         if (!conn->recvPacket(p)) {
-            std::cout << "[Server] Player #" << playerId << " disconnected.\n";
+            if (playerId == 0) break;   // never resumed
 
+            // Unless the player already resumed on another connection
             std::lock_guard<std::mutex> lk(m_clientsMutex);
             for (auto &c : m_clients)
-                if (c.playerId == playerId)
+                if (c.playerId == playerId && c.conn == conn) {
+                    if (playerId < 0)
+                        std::cout << "[Server] Spectator relay " << -playerId << " disconnected.\n";
+                    else
+                        std::cout << "[Server] Player #" << playerId << " disconnected.\n";
                     c.active = false;
+                    c.droppedNs = monotonicNs();
+                    if (c.out) c.out->close();
+                }
             break;
         }
 
+        if (p.type == PacketType::RESUME_GAME && playerId >= 0) {
+            int id = resumeSession(conn, playerId, p.data);
+            if (id < 0 && playerId == 0) break;
+            if (id > 0) {
+                playerId = id;
+                timeval none{0, 0};
+                setsockopt(conn->fd(), SOL_SOCKET, SO_RCVTIMEO, &none, sizeof(none));
+            }
+            continue;
+        }
+        if (playerId == 0) break;
+
         switch (p.type) {
 
             case PacketType::PLAYER_START_GAME:
-                startGameIfPossible(playerId);
+                if (playerId > 0) requestStart();
+                break;
+
+            // The client's answer to JOIN_GAME: its seat token from the lobby
+            case PacketType::JOIN_GAME: {
+                std::string seat = p.data.value("seat", "");
+                if (playerId <= 0 || seat.empty()) break;
+                std::lock_guard<std::mutex> lk(m_clientsMutex);
+                auto st = m_seatTokens.find(seat);
+                if (st == m_seatTokens.end()) break;
+                for (auto &c : m_clients)
+                    if (c.playerId == playerId && !c.lobbyPlayer) {
+                        c.lobbyPlayer = st->second;
+                        m_seatTokens.erase(st);
+                        break;
+                    }
                 break;
+            }
 
             case PacketType::PLAYER_ACTION: {
+                if (playerId < 0) break;   // relays only watch
                 std::string s = p.data.value("action", "");
                 if (s.empty()) break;
+                queueInput(playerId, conn.get(), parseAction(s), p.data);
+                break;
+            }
 
-                ActionType act = ActionType::Stay;
-                if (s == "w") act = ActionType::MoveUp;
-                else if (s == "s") act = ActionType::MoveDown;
-                else if (s == "a") act = ActionType::MoveLeft;
-                else if (s == "d") act = ActionType::MoveRight;
-                else if (s == "b") act = ActionType::PlaceBomb;
+            case PacketType::STATE_ACK: {
+                int turn = p.data.value("turn", -1);
+                bool key = p.data.value("keyframe", false);
 
-                {
-                    std::lock_guard<std::mutex> lk(m_pendingMutex);
-                    m_pendingActions[playerId] = act;
+                std::lock_guard<std::mutex> lk(m_clientsMutex);
+                for (auto &c : m_clients) {
+                    if (c.playerId != playerId) continue;
+                    if (turn > c.ackedTurn) c.ackedTurn = turn;
+                    if (key) c.wantKey = true;
                 }
                 break;
             }
@@ -163,44 +434,272 @@ void BombArenaServer::clientThread(std::shared_ptr<TCPConnection> conn, int play
     }
 }
 
+// Client thread. Moves the session's player onto `conn` and returns its
+// id, or answers with an error and returns -1. `fromId` is the id this
+// connection was given on accept (0 if none); that provisional player is
+// dropped in favour of the resumed one.
+int BombArenaServer::resumeSession(const std::shared_ptr<TCPConnection> &conn, int fromId,
+                                   const nlohmann::json &data) {
+    const uint64_t session = data.value("session", (uint64_t)0);
+    const int64_t now = monotonicNs();
+
+    std::lock_guard<std::mutex> lk(m_clientsMutex);
+    auto it = std::find_if(m_clients.begin(), m_clients.end(), [&](const ClientInfo &c) {
+        return session && c.playerId > 0 && c.session == session;
+    });
+    const char *err = nullptr;
+    if (!m_running)
+        err = "Match is over.";
+    else if (it == m_clients.end())
+        err = "Unknown session.";
+    else if (!it->active && now - it->droppedNs > kResumeGraceMs * 1000000)
+        err = "Session expired.";
+    else if (it->playerId == fromId)
+        err = "Already connected.";
+    if (err) {
+        Packet r;
+        r.type = PacketType::SERVER_RESPONSE;
+        r.data["kind"] = "RESUME_GAME";
+        r.data["ok"] = false;
+        r.data["msg"] = err;
+        conn->sendPacket(r);
+        return -1;
+    }
+    const int playerId = it->playerId;
+
+    // The old connection may not have noticed it is dead yet; its thread
+    // sees the conn has changed and leaves the player alone
+    if (it->active) {
+        shutdown(it->conn->fd(), SHUT_RDWR);
+        it->out->close();
+    }
+    if (fromId > 0)
+        m_clients.erase(std::remove_if(m_clients.begin(), m_clients.end(),
+                                       [&](const ClientInfo &c) { return c.playerId == fromId; }),
+                        m_clients.end());
+
+    for (auto &c : m_clients) {
+        if (c.playerId != playerId) continue;
+        handOverInput(playerId, conn.get());
+        c.conn = conn;
+        c.out = std::make_shared<SendQueue>(conn);
+        c.active = true;
+        c.ackedTurn = -1;
+        c.lastKeyTurn = -1;
+        c.wantKey = true;          // next broadcast is a keyframe
+        c.udpActive = false;
+        c.udpToken = m_udpSock >= 0 ? (m_tokenRng() | 1) : 0;
+
+        Packet j = joinPacket(playerId, c.session, c.udpToken);
+        j.data["resumed"] = true;
+        // Inputs up to here were applied; the client resends the rest
+        j.data["acked_seq"] = inputSlot(playerId)->lastProcessed.load(std::memory_order_relaxed);
+        c.out->push(encodePacket(j));
+        if (m_gameStarted) {
+            Packet s;
+            s.type = PacketType::PLAYER_START_GAME;
+            c.out->push(encodePacket(s));
+        }
+        break;
+    }
+
+    std::cout << "[Server] Player #" << playerId << " resumed.\n";
+    return playerId;
+}
+
+// ========================================================
+// UDP channel
+// ========================================================
+
+void BombArenaServer::udpLoop() {
+    char buf[65536];
+    while (m_running) {
+        pollfd pfd{m_udpSock, POLLIN, 0};
+        if (poll(&pfd, 1, 200) <= 0) continue;
+
+        sockaddr_in from{};
+        socklen_t len = sizeof(from);
+        ssize_t n = recvfrom(m_udpSock, buf, sizeof(buf), 0, (sockaddr *)&from, &len);
+        if (n <= 0 || m_udpLossIn.drop()) continue;
+
+        try {
+            onDatagram(Packet::deserialize(std::string(buf, (size_t)n)), from);
+        } catch (std::exception &) {
+            // not ours / malformed: ignore
+        }
+    }
+}
+
+// Every datagram must carry its sender's token; the source address is
+// refreshed from it, so a client whose port changes keeps working.
+void BombArenaServer::onDatagram(const Packet &p, const sockaddr_in &from) {
+    const uint64_t token = p.data.value("token", (uint64_t)0);
+    if (!token) return;
+
+    int playerId = -1;
+    {
+        std::lock_guard<std::mutex> lk(m_clientsMutex);
+        for (auto &c : m_clients) {
+            if (!c.active || c.udpToken != token) continue;
+            playerId = c.playerId;
+            c.udpAddr = from;
+            c.udpHeardNs = monotonicNs();
+
+            // Also the keepalive, and how a client that timed out comes back
+            if (p.type == PacketType::UDP_HELLO && !c.udpActive) {
+                c.udpActive = true;
+                c.wantKey = true;
+                std::cout << "[Server] Player #" << playerId << " on UDP.\n";
+            }
+            if (p.type == PacketType::STATE_ACK) {
+                int turn = p.data.value("turn", -1);
+                if (turn > c.ackedTurn) c.ackedTurn = turn;
+                if (p.data.value("keyframe", false)) c.wantKey = true;
+            }
+            break;
+        }
+    }
+    if (playerId < 0) return;
+
+    if (p.type == PacketType::UDP_HELLO) {
+        Packet r;
+        r.type = PacketType::UDP_HELLO;
+        r.data["ok"] = true;
+        if (!m_udpLossOut.drop())
+            udpSendTo(m_udpSock, from, r.serialize());
+        return;
+    }
+
+    // Newest inputs last; each datagram repeats the recent unacked ones
+    InputSlot *target = inputSlot(playerId);
+    if (p.type == PacketType::PLAYER_ACTION && m_gameStarted && target &&
+        p.data.contains("inputs")) {
+        InputSlot &slot = *target;
+        const int64_t now = monotonicNs();
+        for (auto &e : p.data["inputs"]) {
+            PlayerInput in;
+            in.seq = e.value("seq", 0u);
+            if (in.seq <= slot.udpQueued) continue;
+            in.act = parseAction(e.value("action", ""));
+            in.recvNs = now;
+            slot.udpQueued = in.seq;
+            if (!slot.udpRing.push(in))
+                slot.dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
 // ========================================================
 // Start game
 // ========================================================
 
-void BombArenaServer::startGameIfPossible(int requesterId) {
-    if (m_gameStarted) return;
+void BombArenaServer::requestStart() {
+    if (!m_gameStarted && !m_startRequested.exchange(true))
+        std::cout << "[Server] Start requested.\n";
+}
 
+void BombArenaServer::startGameIfPossible() {
+    if (m_gameStarted) return;
 
     int count = activePlayerCount();
-    if (count < 2) {
+    if (std::max(count, std::min(m_aiFill, m_maxPlayers)) < 2) {
         std::cout << "[Server] Need >=2 players to start.\n";
         return;
     }
 
-    // Reset arena
-    GameState arena = initTwoPlayerDefault();
-    m_state = arena;
-    m_state.players.clear();
-    m_state.bombs.clear();
-    m_state.lastExplosionCells.clear();
-    m_state.turnNumber = 0;
-
-    // Spawn points for 1–3 players
-    std::vector<std::pair<int,int>> spawns = {
-        {1, 1},
-        {m_state.width - 2, m_state.height - 2},
-        {m_state.width - 2, 1}
-    };
-
-    // Collect active players in ascending ID
-    std::vector<int> ids;
+    // Collect active players in ascending ID, then AI players after them
+    std::vector<int> ids, aiIds;
     {
         std::lock_guard<std::mutex> lk(m_clientsMutex);
         for (auto &c : m_clients)
-            if (c.active)
+            if (c.active && c.playerId > 0)
                 ids.push_back(c.playerId);
+        while ((int)(ids.size() + aiIds.size()) < m_aiFill &&
+               usedSlots() < m_maxPlayers) {
+            int id = freePlayerId();
+            if (!id) break;
+            aiIds.push_back(id);
+            m_aiIds.push_back(id);
+        }
     }
     std::sort(ids.begin(), ids.end());
+    ids.insert(ids.end(), aiIds.begin(), aiIds.end());
+
+    if (!aiIds.empty()) {
+        m_ai = std::make_unique<AiPool>(m_aiThreads, [this](int id, ActionType act) {
+            submitAiInput(id, act);
+        });
+        for (int id : aiIds) m_ai->addPlayer(id);
+        std::cout << "[Server] " << aiIds.size() << " AI player(s) join.\n";
+    }
+
+    // Reset arena
+    m_state = buildArena(ids);
+    m_state.bombFuse = turnsFor(kBombFuseSeconds);
+    m_state.maxTurns = turnsFor(kMatchSeconds);
+
+    m_aoiActive = m_aoiRadius > 0 && (2 * m_aoiRadius + 1 < m_state.width ||
+                                      2 * m_aoiRadius + 1 < m_state.height);
+    if (m_aoiActive) {
+        std::lock_guard<std::mutex> lk(m_clientsMutex);
+        for (auto &c : m_clients)
+            if (!c.views && c.playerId > 0)
+                c.views = std::make_unique<std::array<Snapshot, kSnapshotHistory>>();
+    }
+
+    if (!m_recordPath.empty()) {
+        if (m_replay.open(m_recordPath, m_state, m_tickHz))
+            std::cout << "[Server] Recording match to " << m_recordPath << "\n";
+        else
+            perror(("[Server] Cannot record to " + m_recordPath).c_str());
+    }
+
+    reportToLobby("started", {{"seats", seatList()}, {"tick_hz", m_tickHz}});
+    m_health.alive.store((int)m_state.players.size(), std::memory_order_relaxed);
+
+    // Flag and START together under the lock: a relay or resume that
+    // sees the match started queues its own START, any other gets this one
+    Packet s;
+    s.type = PacketType::PLAYER_START_GAME;
+    SharedBuffer start = encodePacket(s);
+    {
+        std::lock_guard<std::mutex> lk(m_clientsMutex);
+        m_gameStarted = true;
+        for (auto &c : m_clients)
+            if (c.active)
+                c.out->push(start);
+    }
+    std::cout << "[Server] Game started with " << m_state.players.size() << " players.\n";
+    broadcastState();
+
+    // Views reserve as much as the full snapshot, so one bound fits all
+    const size_t bound = encodedSizeBound(m_history[m_state.turnNumber % kSnapshotHistory]);
+    for (auto &b : m_encodePool)
+        if (b.use_count() == 1 && b->capacity() < bound)
+            b->reserve(bound);
+    while (m_encodePool.size() < (size_t)kEncodeSlack * (m_maxPlayers + kMaxRelays)) {
+        m_encodePool.push_back(std::make_shared<std::string>());
+        m_encodePool.back()->reserve(bound);
+    }
+}
+
+// The players in `ids` on an empty map. The classic arena keeps its three
+// corner spawns; further players, and initArena() maps, spawn spread over
+// the map by initArena().
+GameState BombArenaServer::buildArena(const std::vector<int> &ids) const {
+    GameState st = m_width ? initArena(m_width, m_height, 0) : initTwoPlayerDefault();
+    st.players.clear();
+    st.bombs.clear();
+    st.lastExplosionCells.clear();
+    st.turnNumber = 0;
+
+    std::vector<std::pair<int,int>> spawns;
+    if (!m_width)
+        spawns = {{1, 1}, {st.width - 2, st.height - 2}, {st.width - 2, 1}};
+    if (ids.size() > spawns.size())
+        for (auto &p : initArena(st.width, st.height, (int)ids.size()).players)
+            if (std::find(spawns.begin(), spawns.end(), std::make_pair(p.x, p.y)) == spawns.end())
+                spawns.emplace_back(p.x, p.y);
 
     for (size_t i = 0; i < ids.size() && i < spawns.size(); i++) {
         PlayerState ps;
@@ -209,58 +708,279 @@ void BombArenaServer::startGameIfPossible(int requesterId) {
         ps.y = spawns[i].second;
         ps.alive = true;
         ps.bombRange = 3;
-        m_state.players.push_back(ps);
+        st.players.push_back(ps);
     }
-
-    m_gameStarted = true;
-    std::cout << "[Server] Game started with " << m_state.players.size() << " players.\n";
-
-    Packet s;
-    s.type = PacketType::PLAYER_START_GAME;
-    broadcastPacket(s);
-    broadcastState();
+    rebuildOccupancy(st);   // snapshots of turn 0 carry the hash
+    return st;
 }
 
 // ========================================================
-// Tick loop (0.2 seconds)
+// Tick loop (fixed timestep, m_tickHz)
 // ========================================================
 
+static void sleepUntil(int64_t deadlineNs) {
+    timespec ts;
+    ts.tv_sec  = deadlineNs / 1000000000;
+    ts.tv_nsec = deadlineNs % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {}
+}
+
+int BombArenaServer::turnsFor(double seconds) const {
+    return std::max(1, (int)std::lround(seconds * m_tickHz));
+}
+
+// Client thread of `playerId`; only the one reading `from`, the ring's
+// producer, gets through. Inputs before the game starts are dropped so
+// they cannot replay on turn one.
+void BombArenaServer::queueInput(int playerId, const TCPConnection *from, ActionType act,
+                                 const nlohmann::json &data) {
+    if (!m_gameStarted) return;
+    InputSlot *s = inputSlot(playerId);
+    if (!s) return;
+    InputSlot &slot = *s;
+
+    // Announce the push before checking ownership; handOverInput() changes
+    // the owner before waiting for pushing to drop, so one of the two sees
+    // the other (both seq_cst)
+    slot.pushing.fetch_add(1);
+    if (slot.tcpProducer.load() == from) {
+        PlayerInput in;
+        in.seq = data.value("seq", slot.nextSeq);
+        in.act = act;
+        in.recvNs = monotonicNs();
+        slot.nextSeq = in.seq + 1;
+
+        if (!slot.tcpRing.push(in))
+            slot.dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    slot.pushing.fetch_sub(1);
+}
+
+// Resume: `to`'s thread becomes the ring's producer. Returns once no push
+// by the previous one can still be in flight; that is at most one ring
+// push, so spinning is cheap.
+void BombArenaServer::handOverInput(int playerId, const TCPConnection *to) {
+    InputSlot *s = inputSlot(playerId);
+    if (!s) return;
+    InputSlot &slot = *s;
+    slot.tcpProducer.store(to);
+    while (slot.pushing.load() != 0)
+        std::this_thread::yield();
+}
+
+// AI worker thread; the only producer for this AI player's ring. One move
+// waits at a time: a late one is dropped rather than queued behind.
+void BombArenaServer::submitAiInput(int playerId, ActionType act) {
+    InputSlot *s = inputSlot(playerId);
+    if (!s) return;
+    InputSlot &slot = *s;
+    if (!slot.tcpRing.empty()) return;
+
+    PlayerInput in;
+    in.seq = slot.nextSeq++;
+    in.act = act;
+    in.recvNs = monotonicNs();
+    slot.tcpRing.push(in);
+}
+
+// Tick thread only: the rings' single consumer. Takes the oldest new input
+// of each player; the rest wait for later ticks instead of being
+// overwritten. Players with nothing queued stay put (step()'s default).
+void BombArenaServer::drainInputs(int64_t nowNs) {
+    m_acts.clear();
+    for (size_t id = 0; id < m_inputs.size(); id++) {
+        InputSlot &slot = *m_inputs[id];
+        const uint32_t last = slot.lastProcessed.load(std::memory_order_relaxed);
+
+        // Drop what was already applied (via the other channel, or repeats)
+        PlayerInput t, u;
+        bool haveT, haveU;
+        while ((haveT = slot.tcpRing.peek(t)) && t.seq <= last) slot.tcpRing.pop(t);
+        while ((haveU = slot.udpRing.peek(u)) && u.seq <= last) slot.udpRing.pop(u);
+        if (!haveT && !haveU) continue;
+
+        PlayerInput in;
+        if (haveT && (!haveU || t.seq <= u.seq)) slot.tcpRing.pop(in);
+        else                                     slot.udpRing.pop(in);
+
+        slot.lastProcessed.store(in.seq, std::memory_order_relaxed);
+        m_acts.push_back({(int)id, in.act});
+        m_tickStats.recordInput(nowNs - in.recvNs);
+    }
+}
+
+// Deadlines sit on a fixed grid (start + n * period), so work time and
+// wake-up jitter never accumulate into drift. A tick that finishes past
+// the next deadline is an overrun: the next one starts immediately, and if
+// we fell a whole period or more behind those ticks are skipped rather
+// than run back to back.
 void BombArenaServer::tickLoop() {
+    const int64_t period = 1000000000LL / m_tickHz;
+    int64_t deadline = monotonicNs() + period;
 
     while (m_running) {
-        usleep(200000);  // 0.2 sec
-
-        if (!m_gameStarted)
-            continue;
+        sleepUntil(deadline);
+        const int64_t woke = monotonicNs();
 
-        std::vector<PlayerAction> acts;
+        // Turn 0 goes out now; the first step is next tick
+        if (!m_gameStarted && m_startRequested.exchange(false)) {
+            startGameIfPossible();
+        }
+        else if (m_gameStarted) {
+#ifdef BOMBARENA_ALLOC_CHECK
+            const size_t allocsBefore = threadAllocCount();
+#endif
+            drainInputs(woke);
+            m_replay.tick(m_acts);
+            GameResult r = step(m_state, m_acts);
+            broadcastState();
+            // AI moves are due a little before the next tick
+            if (m_ai) m_ai->publish(m_state, deadline + period - period / 5);
+            if (m_state.turnNumber % kReplayChecksumEvery == 0)
+                m_replay.checksum(m_state);
+
+            m_tickStats.recordTick(monotonicNs() - woke, woke - deadline);
+
+            // For monitorLoop(); relaxed, the figures need not agree
+            if (m_tickStats.ticks() % m_tickHz == 0) {
+                if (m_statsMutex.try_lock()) {
+                    m_statsShared = m_tickStats;
+                    m_statsMutex.unlock();
+                }
+                int alive = 0;
+                for (auto &p : m_state.players) alive += p.alive;
+                m_health.turn.store(m_state.turnNumber, std::memory_order_relaxed);
+                m_health.alive.store(alive, std::memory_order_relaxed);
+                m_health.workP99Us.store(m_tickStats.workPercentileUs(0.99), std::memory_order_relaxed);
+                m_health.lateP99Us.store(m_tickStats.latePercentileUs(0.99), std::memory_order_relaxed);
+                m_health.overruns.store(m_tickStats.overruns(), std::memory_order_relaxed);
+            }
 
-        {
-            std::lock_guard<std::mutex> lk(m_pendingMutex);
-
-            if (m_pendingActions.empty()) {
-                // Default actions = stay
-                for (auto &p : m_state.players)
-                    acts.push_back({p.id, ActionType::Stay});
-            } else {
-                for (auto &p : m_pendingActions)
-                    acts.push_back({p.first, p.second});
+#ifdef BOMBARENA_ALLOC_CHECK
+            if (r.type == GameResultType::Ongoing && m_state.turnNumber > 2 * kSnapshotHistory) {
+                size_t n = threadAllocCount() - allocsBefore;
+                m_allocStats.allocs += n;
+                if (n) m_allocStats.dirtyTicks++;
+                if (n > m_allocStats.worst) m_allocStats.worst = n;
+                m_allocStats.ticks++;   // last: the check reads the others after it
+            }
+#endif
+
+            if (r.type != GameResultType::Ongoing) {
+                broadcastGameEnd(r);
+                m_replay.finish(r, m_state);
+                std::cout << "[Tick] final: " << m_tickStats.summary() << "\n";
+                if (m_ai)
+                    std::cout << "[Tick] AI rollouts: " << m_ai->rollouts() << "\n";
+
+                nlohmann::json seats = seatList();
+                for (auto &seat : seats) {
+                    const PlayerState *ps = findPlayer(m_state, seat["id"].get<int>());
+                    seat["alive"] = ps && ps->alive;
+                }
+                reportToLobby("result", {
+                    {"result", r.type == GameResultType::Draw ? "draw" : "win"},
+                    {"winner", r.type == GameResultType::Draw ? -1 : r.winnerId},
+                    {"turns", m_state.turnNumber},
+                    {"seats", seats}
+                });
+                stopAccepting();
+                break;
             }
+        }
 
-            m_pendingActions.clear();
+        deadline += period;
+        int64_t behind = monotonicNs() - deadline;
+        if (behind > 0 && m_gameStarted) {
+            int64_t skip = behind / period;
+            deadline += skip * period;
+            m_tickStats.recordOverrun(skip);
+        } else if (behind >= period) {
+            deadline += (behind / period) * period;   // idle; just realign
         }
+    }
+}
 
-        GameResult r = step(m_state, acts);
-        broadcastState();
+// ========================================================
+// Lobby link
+// ========================================================
 
-        if (r.type != GameResultType::Ongoing) {
-            broadcastGameEnd(r);
-            m_running = false;
-            break;
+void BombArenaServer::connectLobby() {
+    if (!m_lobbyPort) return;
+    auto conn = std::make_shared<TCPConnection>();
+    if (!conn->connectToServer(m_lobbyHost, m_lobbyPort)) {
+        std::cout << "[Server] Lobby " << m_lobbyHost << ":" << m_lobbyPort
+                  << " unreachable, no status reports.\n";
+        return;
+    }
+    m_lobbyConn = conn;
+    m_lobbyOut = std::make_unique<SendQueue>(conn);
+    std::cout << "[Server] Reporting to lobby " << m_lobbyHost << ":" << m_lobbyPort
+              << " as room " << m_roomId << "\n";
+}
+
+void BombArenaServer::reportToLobby(const char *event, nlohmann::json data) {
+    if (!m_lobbyOut) return;
+    Packet p;
+    p.type = PacketType::MATCH_STATUS;
+    p.data = std::move(data);
+    p.data["event"] = event;
+    p.data["room_id"] = m_roomId;
+    p.data["token"] = m_lobbyToken;
+    p.data["port"] = m_port;
+    m_lobbyOut->push(encodePacket(p));
+}
+
+// Once a second while the match runs: the lobby's health report, and
+// every kStatsLogSeconds the tick stats line. A report that races the
+// tick thread's "result" is dropped by the lobby, which has closed the
+// match.
+void BombArenaServer::monitorLoop() {
+    int64_t next = 0;
+    int seconds = 0;
+    while (m_running) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        const int64_t now = monotonicNs();
+        if (!m_gameStarted) next = now + 1000000000LL;
+        if (!m_running || now < next) continue;
+        next += 1000000000LL;
+
+        if (++seconds % kStatsLogSeconds == 0) {
+            TickStats stats;
+            {
+                std::lock_guard<std::mutex> lk(m_statsMutex);
+                stats = m_statsShared;
+            }
+            std::cout << "[Tick] " << m_tickHz << " Hz: " << stats.summary() << "\n";
         }
+
+        if (!m_lobbyOut) continue;
+        reportToLobby("health", {
+            {"turn", m_health.turn.load(std::memory_order_relaxed)},
+            {"alive", m_health.alive.load(std::memory_order_relaxed)},
+            {"clients", activePlayerCount()},
+            {"work_p99_us", m_health.workP99Us.load(std::memory_order_relaxed)},
+            {"late_p99_us", m_health.lateP99Us.load(std::memory_order_relaxed)},
+            {"overruns", m_health.overruns.load(std::memory_order_relaxed)}
+        });
     }
 }
 
+// Everyone in the match, AI players included
+nlohmann::json BombArenaServer::seatList() {
+    nlohmann::json seats = nlohmann::json::array();
+    std::lock_guard<std::mutex> lk(m_clientsMutex);
+    for (auto &p : m_state.players) {
+        nlohmann::json seat = {{"id", p.id}};
+        auto it = std::find_if(m_clients.begin(), m_clients.end(),
+                               [&](const ClientInfo &c) { return c.playerId == p.id; });
+        if (it == m_clients.end())   seat["ai"] = true;
+        else if (it->lobbyPlayer)    seat["lobby_player"] = it->lobbyPlayer;
+        seats.push_back(seat);
+    }
+    return seats;
+}
+
 // ========================================================
 // Broadcasting
 // ========================================================
@@ -269,52 +989,103 @@ int BombArenaServer::activePlayerCount() {
     std::lock_guard<std::mutex> lk(m_clientsMutex);
     int c = 0;
     for (auto &x : m_clients)
-        if (x.active) c++;
+        if (x.active && x.playerId > 0) c++;
     return c;
 }
 
+// Each client gets a delta against the last turn it acknowledged, or a
+// full keyframe if it never acked (older clients), asked for one, fell out
+// of the history window, or is due for the periodic refresh.
 void BombArenaServer::broadcastState() {
-    Packet s;
-    s.type = PacketType::STATE_UPDATE;
+    Snapshot &cur = m_history[m_state.turnNumber % kSnapshotHistory];
+    captureSnapshot(m_state, cur);
+    cur.acks.clear();
+    for (size_t id = 0; id < m_inputs.size(); id++) {
+        uint32_t seq = m_inputs[id]->lastProcessed.load(std::memory_order_relaxed);
+        if (seq) cur.acks.emplace_back((int)id, seq);
+    }
 
-    s.data["turn"] = m_state.turnNumber;
+    // Clients usually share a baseline; encode each distinct payload once.
+    // Area-of-interest views differ per client and are encoded each.
+    m_built.clear();
+    if (m_aoiActive)
+        m_aoi.build(cur, m_state.width, m_state.height);
 
-    // Players
-    nlohmann::json jp = nlohmann::json::array();
-    for (auto &p : m_state.players) {
-        nlohmann::json t;
-        t["id"] = p.id;
-        t["x"] = p.x;
-        t["y"] = p.y;
-        t["alive"] = p.alive;
-        jp.push_back(t);
-    }
-    s.data["players"] = jp;
+    std::lock_guard<std::mutex> lk(m_clientsMutex);
+    const int64_t now = monotonicNs();
+    for (auto &c : m_clients) {
+        if (!c.active) continue;
+
+        if (c.udpActive && now - c.udpHeardNs > kUdpTimeoutMs * 1000000) {
+            std::cout << "[Server] Player #" << c.playerId << " silent on UDP, back to TCP.\n";
+            c.udpActive = false;
+            c.wantKey = true;
+        }
 
-    // Bombs
-    nlohmann::json jb = nlohmann::json::array();
-    for (auto &b : m_state.bombs) {
-        nlohmann::json t;
-        t["x"] = b.x;
-        t["y"] = b.y;
-        t["timer"] = b.timer;
-        t["ownerId"] = b.ownerId;
-        t["range"] = b.range;
-        jb.push_back(t);
-    }
-    s.data["bombs"] = jb;
+        // A client without a player in the match sees everything
+        const PlayerState *self = findPlayer(m_state, c.playerId);
+        const bool own = m_aoiActive && c.views && self;
+        const auto &hist = own ? *c.views : m_history;
+        if (own) {
+            Snapshot &v = (*c.views)[cur.turn % kSnapshotHistory];
+            m_aoi.query(cur, self->x, self->y, m_aoiRadius, v);
+            v.acks.clear();
+            InputSlot *slot = inputSlot(c.playerId);
+            uint32_t seq = slot ? slot->lastProcessed.load(std::memory_order_relaxed) : 0;
+            if (seq) v.acks.emplace_back(c.playerId, seq);
+        }
+        const Snapshot &snap = hist[cur.turn % kSnapshotHistory];
+
+        int base = -1;
+        if (!c.wantKey && c.ackedTurn >= 0 && c.ackedTurn < cur.turn &&
+            cur.turn - c.lastKeyTurn < kKeyframeInterval) {
+            const Snapshot &h = hist[c.ackedTurn % kSnapshotHistory];
+            if (h.turn == c.ackedTurn) base = h.turn;
+        }
+
+        SharedBuffer line;
+        auto it = std::find_if(m_built.begin(), m_built.end(),
+                               [&](const std::pair<int, SharedBuffer> &e) { return e.first == base; });
+        if (own || it == m_built.end()) {
+            std::shared_ptr<std::string> buf = acquireEncodeBuffer();
+            if (buf->capacity() < encodedSizeBound(snap))
+                buf->reserve(encodedSizeBound(snap));
+            encodeStateUpdate(base < 0 ? nullptr : &hist[base % kSnapshotHistory],
+                              snap, *buf);
+            line = std::move(buf);
+            if (!own) m_built.emplace_back(base, line);
+        } else {
+            line = it->second;
+        }
 
-    // Explosions
-    nlohmann::json je = nlohmann::json::array();
-    for (auto &c : m_state.lastExplosionCells) {
-        nlohmann::json t;
-        t["x"] = c.first;
-        t["y"] = c.second;
-        je.push_back(t);
+        if (base < 0) {
+            c.lastKeyTurn = cur.turn;
+            c.wantKey = false;
+        }
+        // Datagrams may be lost; the client acks what arrives and deltas
+        // keep following its acked turn
+        if (c.udpActive && line->size() <= kMaxDatagram) {
+            if (!m_udpLossOut.drop())
+                udpSendTo(m_udpSock, c.udpAddr, *line);
+            continue;
+        }
+        // A dropped backlog means the client's baseline is gone
+        if (!c.out->push(line))
+            c.wantKey = true;
     }
-    s.data["explosions"] = je;
+}
 
-    broadcastPacket(s);
+// Only the pool itself referencing a buffer means every queue has written
+// it out; the tick thread is the only one handing buffers out.
+std::shared_ptr<std::string> BombArenaServer::acquireEncodeBuffer() {
+    for (auto &b : m_encodePool)
+        if (b.use_count() == 1) {
+            // Pairs with the writer's release of its reference
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return b;
+        }
+    m_encodePool.push_back(std::make_shared<std::string>());
+    return m_encodePool.back();
 }
 
 void BombArenaServer::broadcastGameEnd(const GameResult &r) {
@@ -333,9 +1104,12 @@ void BombArenaServer::broadcastGameEnd(const GameResult &r) {
     broadcastPacket(p);
 }
 
+// Encoded once; every client queue shares the same bytes
 void BombArenaServer::broadcastPacket(const Packet &p) {
+    SharedBuffer buf = encodePacket(p);
+
     std::lock_guard<std::mutex> lk(m_clientsMutex);
     for (auto &c : m_clients)
         if (c.active)
-            c.conn->sendPacket(p);
+            c.out->push(buf);
 }
@@ -2,17 +2,62 @@
 #include "../shared/tcp.hpp"
 #include "../shared/packet.hpp"
 #include "../engine/engine.hpp"
+#include "../engine/snapshot.hpp"
+#include "../engine/replay.hpp"
+#include "tick_stats.hpp"
+#include "ai_pool.hpp"
+#include "../shared/spsc_ring.hpp"
+#include "../shared/udp.hpp"
 
+#include <array>
+#include <cstdint>
 #include <vector>
 #include <memory>
 #include <mutex>
 #include <atomic>
+#include <random>
+#include <string>
 #include <unordered_map>
+#include <utility>
+
+// Command-line settings of one game server process
+struct ServerOptions {
+    int port = 16000;
+    int tickHz = 5;            // turns per second
+    std::string recordPath;    // match log (engine/replay.hpp); empty = off
+    bool   udp = true;         // offer the UDP channel (same port number)
+    double udpLoss = 0.0;      // drop this fraction of UDP datagrams, both ways
+
+    // Map: 0 x 0 is the classic open 11x11 arena, anything else an
+    // initArena() map with pillars
+    int width = 0, height = 0;
+    int maxPlayers = 3;
+    int aoiRadius = 8;         // cells each client sees around itself; 0 = everything
+
+    int aiFill = 0;            // at start, add AI players up to this many players
+    int aiThreads = 1;         // AI worker threads
+
+    int spectatorPort = 0;     // snapshot feed for spectator relays; 0 = off
+
+    // Lobby that launched us, for MATCH_STATUS reports; port 0 = standalone
+    std::string lobbyHost = "127.0.0.1";
+    int lobbyPort = 0;
+    int roomId = 0;
+    std::string lobbyToken;    // echoed so the lobby knows the report is ours
+    // Seat token -> lobby account, one per player the lobby sent here
+    std::unordered_map<std::string, int> seats;
+};
+
+#ifdef BOMBARENA_ALLOC_CHECK
+// Heap allocations made so far by the calling thread; defined by
+// bench/tick_alloc_check.cpp, which builds the server with this flag
+size_t threadAllocCount();
+#endif
 
 class BombArenaServer {
 
 public:
-    BombArenaServer(int port);
+    explicit BombArenaServer(const ServerOptions &opts);
     ~BombArenaServer();
 
     void run();
@@ -26,26 +71,128 @@ private:
     int m_listenSock = -1;
 
     bool setupListenSocket();
+    static int openListenSocket(int port);
     void closeListenSocket();
 
     void acceptLoop();
     void clientThread(std::shared_ptr<TCPConnection> conn, int playerId);
 
+    // =======================================
+    // Shutdown
+    // =======================================
+    // Once the match is over the tick thread shuts the listen sockets down,
+    // which wakes the accept loops. run() then lets every send queue write
+    // out what it holds (GAME_END included), at most kDrainMs per client,
+    // shuts the client sockets down to wake their recv()s, and waits for
+    // the threads before returning.
+    static constexpr int kDrainMs = 2000;
+    std::thread m_tickThread, m_udpThread, m_spectatorThread;
+    std::atomic<int> m_clientThreads{0};
+    void stopAccepting();
+    void drainClients();
+
+    // =======================================
+    // Lobby link
+    // =======================================
+    // MATCH_STATUS packets to the lobby: "started" with the seats, "health"
+    // once a second while the match runs, "result" at the end. Queued, so
+    // the tick thread never waits on the lobby. The health report is built
+    // on the monitor thread from figures the tick thread publishes, so
+    // steady ticks stay free of JSON and allocations.
+    //
+    // Seats carry a lobby account only if the client answered JOIN_GAME
+    // with a seat token the lobby gave that account (and us, at launch);
+    // each token seats one client. Clients never name accounts themselves.
+    const std::string m_lobbyHost;
+    const int m_lobbyPort, m_roomId;
+    const std::string m_lobbyToken;
+    std::unordered_map<std::string, int> m_seatTokens;   // m_clientsMutex; claimed ones erased
+    std::shared_ptr<TCPConnection> m_lobbyConn;
+    std::unique_ptr<SendQueue> m_lobbyOut;
+    struct Health {
+        std::atomic<int>      turn{0};
+        std::atomic<int>      alive{0};
+        std::atomic<int64_t>  workP99Us{0};
+        std::atomic<int64_t>  lateP99Us{0};
+        std::atomic<uint64_t> overruns{0};
+    } m_health;                                  // written by the tick thread
+    void connectLobby();
+    void reportToLobby(const char *event, nlohmann::json data);
+    nlohmann::json seatList();   // locks m_clientsMutex
+
+    // =======================================
+    // Reconnect
+    // =======================================
+    // JOIN_GAME carries a session token. A client whose connection drops
+    // can open a new one within kResumeGraceMs and send RESUME_GAME with
+    // it; it gets its player back (a fresh JOIN_GAME with resumed:true
+    // and the last input seq applied), then a keyframe. Its player stays
+    // in the match meanwhile and just gets no input. Once a match runs,
+    // new connections get no JOIN_GAME and are dropped unless they resume.
+    static constexpr int64_t kResumeGraceMs = 30000;
+    static constexpr int kResumeWaitMs = 5000;   // for a connection's RESUME_GAME
+    int resumeSession(const std::shared_ptr<TCPConnection> &conn, int fromId,
+                      const nlohmann::json &data);
+    Packet joinPacket(int playerId, uint64_t session, uint64_t udpToken) const;
+
+    // =======================================
+    // Spectator relays
+    // =======================================
+    // A relay (relay/spectator_relay.cpp) subscribes on m_spectatorPort
+    // and fans the match out to any number of watchers, so this process
+    // only ever serves kMaxRelays extra streams. Relays sit in m_clients
+    // with negative ids: they get every player's full-state updates
+    // (sharing their encodings), acknowledge like clients, and never play.
+    const int m_spectatorPort;
+    int m_spectatorSock = -1;
+    int m_nextRelayId = -1;
+    static constexpr int kMaxRelays = 4;
+
+    void spectatorAcceptLoop();
+    int usedSlots() const;   // caller holds m_clientsMutex
+
     // =======================================
     // Game state
     // =======================================
     bombarena::GameState m_state;
 
-    bool m_gameStarted = false;
+    std::atomic<bool> m_gameStarted{false};     // written by the tick thread only
+    std::atomic<bool> m_startRequested{false};  // PLAYER_START_GAME seen, tick thread to act
     std::atomic<bool> m_running{true};
 
-    int m_nextPlayerId = 1;
-    const int m_maxPlayers = 3;
+    // Player ids are seats, 1..m_maxPlayers: a seat given up (a provisional
+    // player that resumed another) is handed out again, never a new id
+    const int m_maxPlayers;
+    int freePlayerId() const;   // caller holds m_clientsMutex; 0 = none
+    const int m_width, m_height;   // 0 x 0 = classic arena
+    // The map's actual size, for JOIN_GAME. Set in run() before any other
+    // thread exists and never changed, so the accept, relay and resume
+    // threads read it instead of m_state, which the tick thread owns.
+    int m_mapWidth = 0, m_mapHeight = 0;
 
     struct ClientInfo {
         int playerId;
         std::shared_ptr<TCPConnection> conn;
         bool active;
+        std::shared_ptr<SendQueue> out;   // everything server -> client
+
+        uint64_t session = 0;      // RESUME_GAME token
+        int lobbyPlayer = 0;       // lobby account, from its seat token
+        int64_t  droppedNs = 0;    // when the connection was lost
+
+        int  ackedTurn   = -1;     // last STATE_ACK; -1 = never acked
+        int  lastKeyTurn = -1;     // last keyframe sent
+        bool wantKey     = false;  // client lost its baseline
+
+        // UDP channel: snapshots go to udpAddr while the client keeps
+        // sending datagrams; otherwise everything stays on TCP
+        uint64_t    udpToken = 0;
+        bool        udpActive = false;
+        sockaddr_in udpAddr{};
+        int64_t     udpHeardNs = 0;
+
+        // Area-of-interest views sent to this client, slot = turn % history
+        std::unique_ptr<std::array<bombarena::Snapshot, bombarena::kSnapshotHistory>> views{};
     };
 
     std::vector<ClientInfo> m_clients;
@@ -54,19 +201,156 @@ private:
     int activePlayerCount();
 
     // =======================================
-    // Multi-player pending actions per tick
+    // Player input
     // =======================================
-    std::mutex m_pendingMutex;
-    std::unordered_map<int, bombarena::ActionType> m_pendingActions;
+    // Every PLAYER_ACTION is queued in one of its player's rings and
+    // drained by the tick thread, one input per player per tick, with no
+    // lock on either side. TCP inputs come from that player's client
+    // thread, UDP inputs from the UDP thread; each ring has one producer
+    // and the drain merges them by seq. Rings are allocated once per
+    // player id; m_acts is the reused step() input.
+    //
+    // A resume moves the player to a new connection while the old one's
+    // thread may still be handling a last PLAYER_ACTION. tcpProducer names
+    // the connection whose thread owns tcpRing and nextSeq; handOverInput()
+    // switches it and waits out a push already under way, so the two
+    // threads never produce at once.
+    struct PlayerInput {
+        uint32_t seq = 0;
+        bombarena::ActionType act = bombarena::ActionType::Stay;
+        int64_t  recvNs = 0;        // monotonic time the client thread read it
+    };
+    static constexpr size_t kInputRing = 16;   // ~3 s of backlog at 5 Hz
+
+    struct InputSlot {
+        SpscRing<PlayerInput, kInputRing> tcpRing;
+        SpscRing<PlayerInput, kInputRing> udpRing;
+        uint32_t nextSeq = 1;             // producer thread; for clients sending no seq
+        std::atomic<const TCPConnection*> tcpProducer{nullptr};
+        std::atomic<int> pushing{0};      // queueInput()s inside the producer check
+        uint32_t udpQueued = 0;           // UDP thread; skips redundant repeats
+        std::atomic<uint32_t> lastProcessed{0};   // written by the tick thread; acked in snapshots
+        std::atomic<uint64_t> dropped{0}; // ring was full
+    };
+    std::vector<std::unique_ptr<InputSlot>> m_inputs;   // by player id
+    InputSlot *inputSlot(int playerId);   // nullptr outside 1..m_maxPlayers
+    std::vector<bombarena::PlayerAction> m_acts;
+
+    void queueInput(int playerId, const TCPConnection *from, bombarena::ActionType act,
+                    const nlohmann::json &data);
+    void handOverInput(int playerId, const TCPConnection *to);   // m_clientsMutex
+    void drainInputs(int64_t nowNs);
+
+    // =======================================
+    // AI players
+    // =======================================
+    // Added at game start to fill the room up to m_aiFill players. They
+    // take the free seats and are played by m_ai's workers, whose moves
+    // go through the same input rings as a client's (the worker is the
+    // ring's producer; there is no client thread for these ids).
+    const int m_aiFill;
+    const int m_aiThreads;
+    std::vector<int> m_aiIds;            // m_clientsMutex
+    std::unique_ptr<AiPool> m_ai;
+    void submitAiInput(int playerId, bombarena::ActionType act);
+
+    // =======================================
+    // UDP channel for PLAYER_ACTION / STATE_UPDATE / STATE_ACK
+    // =======================================
+    // JOIN_GAME hands out udp_port + udp_token; the client proves it owns
+    // the token with UDP_HELLO. Snapshots then go by datagram (too-large
+    // ones still by TCP), and if the client goes quiet on UDP for
+    // kUdpTimeoutMs it falls back to TCP with a fresh keyframe.
+    const bool m_udpOffered;
+    int m_udpSock = -1;
+    LossInjector m_udpLossIn;    // UDP thread
+    LossInjector m_udpLossOut;   // tick thread
+    std::mt19937_64 m_tokenRng{std::random_device{}()};   // m_clientsMutex
+    static constexpr int64_t kUdpTimeoutMs = 2000;
+
+    void udpLoop();
+    void onDatagram(const Packet &p, const sockaddr_in &from);
 
     void tickLoop();   // <-- REQUIRED
 
+    // Fixed timestep on CLOCK_MONOTONIC with absolute deadlines
+    const int m_tickHz;
+    TickStats m_tickStats;                       // tick thread only
+
+    // Once a second the tick thread copies its stats into m_statsShared
+    // (skipping the copy rather than waiting if the lock is busy) and
+    // stores the health figures. The monitor thread formats and prints
+    // the stats line every kStatsLogSeconds and sends the lobby its
+    // health report, so no string is built on the tick thread.
+#ifdef BOMBARENA_ALLOC_CHECK
+    static constexpr int kStatsLogSeconds = 2;   // logs inside the check's window
+#else
+    static constexpr int kStatsLogSeconds = 30;
+#endif
+    TickStats m_statsShared;                     // m_statsMutex
+    std::mutex m_statsMutex;
+    std::thread m_monitorThread;
+    void monitorLoop();
+
+    // Rules in wall-clock time; turned into turns for the tick rate
+    static constexpr double kBombFuseSeconds = 2.0;
+    static constexpr double kMatchSeconds    = 40.0;
+    int turnsFor(double seconds) const;
+
+    // Match recording: initial state at start, every tick's actions,
+    // periodic checksums, result
+    std::string m_recordPath;
+    bombarena::ReplayWriter m_replay;            // tick thread after start
+    static constexpr int kReplayChecksumEvery = 50;   // turns
+
     // =======================================
     // Game control
     // =======================================
-    void startGameIfPossible(int requesterId);
+    // A client thread only asks; the tick thread starts the match at its
+    // next tick, so m_state and the broadcast buffers keep one owner
+    void requestStart();
+    void startGameIfPossible();   // tick thread
+
+    bombarena::GameState buildArena(const std::vector<int> &ids) const;
+
+    // Turn snapshots for delta encoding, slot = turn % kSnapshotHistory
+    std::array<bombarena::Snapshot, bombarena::kSnapshotHistory> m_history;
+    static constexpr int kKeyframeInterval = 50;   // turns
+
+    // On maps wider than a client's window each client gets only what is
+    // within m_aoiRadius of its player, delta-encoded against its own views
+    const int m_aoiRadius;
+    bool m_aoiActive = false;                    // set at game start
+    bombarena::AoiIndex m_aoi;                   // tick thread
+
+    // Encoded STATE_UPDATE lines. A buffer is rewritten once no send queue
+    // holds it any more, so steady-state ticks encode without allocating.
+    // The match starts with kEncodeSlack ticks' worth of buffers, sized
+    // for a full snapshot; the pool only grows past that for a queue
+    // further behind.
+    static constexpr int kEncodeSlack = 4;
+    std::vector<std::shared_ptr<std::string>> m_encodePool;
+    std::vector<std::pair<int, SharedBuffer>> m_built;   // this tick, by base turn
+    std::shared_ptr<std::string> acquireEncodeBuffer();
 
     void broadcastPacket(const Packet &p);
     void broadcastState();
     void broadcastGameEnd(const bombarena::GameResult &res);
+
+#ifdef BOMBARENA_ALLOC_CHECK
+public:
+    // The tick thread's allocations in steady-state ticks: from turn
+    // 2 * kSnapshotHistory on (history, encode pool and send queues are
+    // warm by then), every tick but the match's last
+    struct AllocStats {
+        std::atomic<long>   ticks{0};
+        std::atomic<size_t> allocs{0};
+        std::atomic<long>   dirtyTicks{0};
+        std::atomic<size_t> worst{0};
+    };
+    const AllocStats &allocStats() const { return m_allocStats; }
+
+private:
+    AllocStats m_allocStats;
+#endif
 };
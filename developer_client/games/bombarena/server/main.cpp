@@ -1,16 +1,18 @@
 #include "game_server.hpp"
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 
 int main(int argc, char** argv) {
     std::cout<<"starting game_server...\n";
-    int port = 16000; // fallback only 
+    ServerOptions opts;   // port 16000 is a fallback only
 
     for (int i = 1; i < argc; i++) {
         std::string arg = argv[i];
 
         if (arg == "--port" && i + 1 < argc) {
             try {
-                port = std::stoi(argv[i + 1]);
+                opts.port = std::stoi(argv[i + 1]);
             } catch (...) {
                 std::cerr << "[BombArenaServer] Invalid port: "
                           << argv[i + 1] << "\n";
@@ -18,16 +20,156 @@ int main(int argc, char** argv) {
             }
             i++; 
         }
+        else if (arg == "--tick-rate" && i + 1 < argc) {
+            try {
+                opts.tickHz = std::stoi(argv[i + 1]);
+            } catch (...) {
+                opts.tickHz = 0;
+            }
+            i++;
+        }
+        else if (arg == "--spectator-port" && i + 1 < argc) {
+            try {
+                opts.spectatorPort = std::stoi(argv[i + 1]);
+            } catch (...) {
+                opts.spectatorPort = -1;
+            }
+            i++;
+        }
+        else if (arg == "--lobby-port" && i + 1 < argc) {
+            try {
+                opts.lobbyPort = std::stoi(argv[i + 1]);
+            } catch (...) {
+                opts.lobbyPort = -1;
+            }
+            i++;
+        }
+        else if (arg == "--room-id" && i + 1 < argc) {
+            try {
+                opts.roomId = std::stoi(argv[i + 1]);
+            } catch (...) {
+                opts.roomId = 0;
+            }
+            i++;
+        }
+        else if (arg == "--lobby-host" && i + 1 < argc) {
+            opts.lobbyHost = argv[++i];
+        }
+        else if (arg == "--lobby-token" && i + 1 < argc) {
+            opts.lobbyToken = argv[++i];
+        }
+        // account:token,account:token,...
+        else if (arg == "--seats" && i + 1 < argc) {
+            std::string list = argv[++i];
+            size_t pos = 0;
+            while (pos < list.size()) {
+                size_t end = list.find(',', pos);
+                if (end == std::string::npos) end = list.size();
+                std::string item = list.substr(pos, end - pos);
+                size_t colon = item.find(':');
+                int account = colon == std::string::npos ? 0 : std::atoi(item.c_str());
+                if (account <= 0 || colon + 1 >= item.size()) {
+                    std::cerr << "[BombArenaServer] Bad --seats entry: " << item << "\n";
+                    return 1;
+                }
+                opts.seats[item.substr(colon + 1)] = account;
+                pos = end + 1;
+            }
+        }
+        else if (arg == "--record" && i + 1 < argc) {
+            opts.recordPath = argv[++i];
+        }
+        else if ((arg == "--width" || arg == "--height" || arg == "--max-players" ||
+                  arg == "--aoi" || arg == "--ai-fill" || arg == "--ai-threads") && i + 1 < argc) {
+            int v;
+            try {
+                v = std::stoi(argv[i + 1]);
+            } catch (...) {
+                v = -1;
+            }
+            if (arg == "--width")            opts.width = v;
+            else if (arg == "--height")      opts.height = v;
+            else if (arg == "--max-players") opts.maxPlayers = v;
+            else if (arg == "--ai-fill")     opts.aiFill = v;
+            else if (arg == "--ai-threads")  opts.aiThreads = v;
+            else                             opts.aoiRadius = v;
+            i++;
+        }
+        else if (arg == "--no-udp") {
+            opts.udp = false;
+        }
+        else if (arg == "--udp-loss" && i + 1 < argc) {
+            try {
+                opts.udpLoss = std::stod(argv[i + 1]);
+            } catch (...) {
+                opts.udpLoss = -1;
+            }
+            i++;
+        }
+    }
+
+    if (opts.tickHz < 1 || opts.tickHz > 240) {
+        std::cerr << "[BombArenaServer] --tick-rate must be 1..240 Hz\n";
+        return 1;
+    }
+
+    if (opts.udpLoss < 0 || opts.udpLoss >= 1) {
+        std::cerr << "[BombArenaServer] --udp-loss must be in [0, 1)\n";
+        return 1;
+    }
+
+    // One side given: square map
+    if (opts.width && !opts.height)  opts.height = opts.width;
+    if (opts.height && !opts.width)  opts.width = opts.height;
+    if ((opts.width || opts.height) &&
+        (opts.width < 5 || opts.width > 512 || opts.height < 5 || opts.height > 512)) {
+        std::cerr << "[BombArenaServer] --width/--height must be 5..512\n";
+        return 1;
+    }
+
+    // Every player needs its own spawn cell (odd x and y)
+    int w = opts.width ? opts.width : 11, h = opts.height ? opts.height : 11;
+    int spawns = ((w - 1) / 2) * ((h - 1) / 2);
+    if (opts.maxPlayers < 2 || opts.maxPlayers > std::min(64, spawns)) {
+        std::cerr << "[BombArenaServer] --max-players must be 2.."
+                  << std::min(64, spawns) << " on this map\n";
+        return 1;
     }
 
-    if (port < 10000) {
+    if (opts.aiFill < 0 || opts.aiFill > opts.maxPlayers) {
+        std::cerr << "[BombArenaServer] --ai-fill must be 0..max players\n";
+        return 1;
+    }
+    if (opts.aiThreads < 1 || opts.aiThreads > 64) {
+        std::cerr << "[BombArenaServer] --ai-threads must be 1..64\n";
+        return 1;
+    }
+
+    if (opts.aoiRadius < 0) {
+        std::cerr << "[BombArenaServer] --aoi must be >= 0\n";
+        return 1;
+    }
+
+    if (opts.port < 10000) {
         std::cerr << "[BombArenaServer] ERROR: CSIT requires port >= 10000\n";
         return 1;
     }
 
-    std::cout << "[BombArenaServer] Starting on port " << port << "...\n";
+    if (opts.spectatorPort && (opts.spectatorPort < 10000 || opts.spectatorPort > 65535 ||
+                               opts.spectatorPort == opts.port)) {
+        std::cerr << "[BombArenaServer] --spectator-port must be 10000..65535 and not --port\n";
+        return 1;
+    }
+
+    if (opts.lobbyPort < 0 || opts.lobbyPort > 65535) {
+        std::cerr << "[BombArenaServer] --lobby-port must be 1..65535\n";
+        return 1;
+    }
+
+    std::cout << "[BombArenaServer] Starting on port " << opts.port
+              << " at " << opts.tickHz << " Hz...\n";
 
-    BombArenaServer server(port);
+    BombArenaServer server(opts);
     server.run();
 
     return 0;
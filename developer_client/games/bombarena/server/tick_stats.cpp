@@ -0,0 +1,56 @@
+#include "tick_stats.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+void TickStats::add(Histogram &h, int64_t ns) {
+    int64_t us = std::max<int64_t>(ns, 0) / 1000;
+    int b = 0;
+    while (us > 0 && b < kBuckets - 1) {
+        us >>= 1;
+        b++;
+    }
+    h[b]++;
+}
+
+void TickStats::recordTick(int64_t workNs, int64_t lateNs) {
+    m_ticks++;
+    add(m_work, workNs);
+    add(m_late, lateNs);
+    m_maxWorkNs = std::max(m_maxWorkNs, workNs);
+    m_maxLateNs = std::max(m_maxLateNs, lateNs);
+}
+
+void TickStats::recordOverrun(int64_t skipped) {
+    m_overruns++;
+    m_skipped += (uint64_t)skipped;
+}
+
+int64_t TickStats::percentile(const Histogram &h, double q) {
+    uint64_t total = 0;
+    for (uint64_t n : h) total += n;
+    if (total == 0) return 0;
+    uint64_t want = (uint64_t)(q * (double)total);
+    if (want >= total) want = total - 1;
+
+    uint64_t seen = 0;
+    for (int b = 0; b < kBuckets; b++) {
+        seen += h[b];
+        if (seen > want) return (int64_t)1 << b;   // bucket b holds [2^(b-1), 2^b)
+    }
+    return (int64_t)1 << (kBuckets - 1);
+}
+
+std::string TickStats::summary() const {
+    std::ostringstream o;
+    o << m_ticks << " ticks, " << m_overruns << " overruns ("
+      << m_skipped << " skipped)"
+      << ", work p50<" << workPercentileUs(0.50) << "us"
+      << " p99<" << workPercentileUs(0.99) << "us"
+      << " max " << m_maxWorkNs / 1000 << "us"
+      << ", wake late p99<" << latePercentileUs(0.99) << "us"
+      << " max " << m_maxLateNs / 1000 << "us"
+      << ", input wait p50<" << inputPercentileUs(0.50) << "us"
+      << " p99<" << inputPercentileUs(0.99) << "us";
+    return o.str();
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string>
+
+// Bookkeeping for a fixed-timestep tick thread: how long each tick's work
+// took, how late the thread woke up, how long inputs waited to be applied,
+// and how often the work ran past the next deadline. Histograms use power-of-two microsecond buckets, so the
+// percentiles are upper bounds within a factor of two.
+class TickStats {
+public:
+    static constexpr int kBuckets = 24;   // [0,1) [1,2) [2,4) ... us, last open-ended
+
+    void recordTick(int64_t workNs, int64_t lateNs);
+    // A tick finished after the next deadline; `skipped` whole periods
+    // were dropped to get back on the grid
+    void recordOverrun(int64_t skipped);
+    // An input applied this tick, `waitNs` after it was received
+    void recordInput(int64_t waitNs) { add(m_input, waitNs); }
+
+    uint64_t ticks() const { return m_ticks; }
+    uint64_t overruns() const { return m_overruns; }
+    uint64_t skipped() const { return m_skipped; }
+
+    // Upper bound, in microseconds, of the q-quantile (0..1)
+    int64_t workPercentileUs(double q) const { return percentile(m_work, q); }
+    int64_t latePercentileUs(double q) const { return percentile(m_late, q); }
+    int64_t inputPercentileUs(double q) const { return percentile(m_input, q); }
+
+    // One log line: counts, percentiles, maxima
+    std::string summary() const;
+    void reset() { *this = TickStats(); }
+
+private:
+    using Histogram = std::array<uint64_t, kBuckets>;
+
+    static void add(Histogram &h, int64_t ns);
+    static int64_t percentile(const Histogram &h, double q);
+
+    Histogram m_work{};
+    Histogram m_late{};
+    Histogram m_input{};
+    uint64_t m_ticks = 0;
+    uint64_t m_overruns = 0;
+    uint64_t m_skipped = 0;
+    int64_t  m_maxWorkNs = 0;
+    int64_t  m_maxLateNs = 0;
+};
@@ -20,13 +20,22 @@ enum class PacketType {
     PLAYER_CREATE_ROOM,
     PLAYER_JOIN_ROOM,
     PLAYER_START_GAME,
+    PLAYER_QUEUE,
+    PLAYER_LEAVE_QUEUE,
     PLAYER_SUBMIT_REVIEW = 140,
     PLAYER_GET_REVIEWS  = 141,
+    PLAYER_GET_LEADERBOARD = 142,
     // Game server <-> Game client
     JOIN_GAME = 200,
     PLAYER_ACTION,
     STATE_UPDATE,
     GAME_END,
+    STATE_ACK,          // client -> server: last applied turn
+    UDP_HELLO,          // binds a client's UDP address to its JOIN_GAME token
+    RESUME_GAME,        // client -> server: back into a match with its session token
+
+    // Game server -> Lobby
+    MATCH_STATUS = 250, // lifecycle of a launched match: started, health, result
 
     // Generic
     SERVER_RESPONSE = 300,
@@ -0,0 +1,72 @@
+#ifndef SPSC_RING_HPP
+#define SPSC_RING_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Bounded single-producer / single-consumer queue. One thread may call
+// push(), one other thread may call pop(); neither ever blocks or takes a
+// lock. N must be a power of two. Storage is inline, so a ring never
+// allocates after construction.
+template <typename T, size_t N>
+class SpscRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+    // Producer side. Returns false (and drops v) when the ring is full.
+    bool push(const T &v) {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_headCache == N) {
+            m_headCache = m_head.load(std::memory_order_acquire);
+            if (tail - m_headCache == N) return false;
+        }
+        m_slots[tail & (N - 1)] = v;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Returns false when empty.
+    bool pop(T &out) {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tailCache) {
+            m_tailCache = m_tail.load(std::memory_order_acquire);
+            if (head == m_tailCache) return false;
+        }
+        out = m_slots[head & (N - 1)];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side: copies the oldest entry without removing it
+    bool peek(T &out) {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tailCache) {
+            m_tailCache = m_tail.load(std::memory_order_acquire);
+            if (head == m_tailCache) return false;
+        }
+        out = m_slots[head & (N - 1)];
+        return true;
+    }
+
+    // Either side; a snapshot that the other side may already have changed
+    bool empty() const {
+        return m_head.load(std::memory_order_relaxed) ==
+               m_tail.load(std::memory_order_acquire);
+    }
+
+    static constexpr size_t capacity() { return N; }
+
+private:
+    // Each side owns a cache line: its index plus a cached copy of the
+    // other side's, refreshed only when the ring looks full / empty
+    alignas(64) std::atomic<size_t> m_head{0};
+    size_t m_tailCache = 0;                      // consumer's view of m_tail
+
+    alignas(64) std::atomic<size_t> m_tail{0};
+    size_t m_headCache = 0;                      // producer's view of m_head
+
+    alignas(64) std::array<T, N> m_slots{};
+};
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef UDP_HPP
+#define UDP_HPP
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <random>
+#include <string>
+
+// In-match datagrams carry the same packet lines as TCP, one per datagram.
+// Anything larger than this goes over TCP instead.
+constexpr size_t kMaxDatagram = 1400;
+
+// How many of the newest unacknowledged inputs each action datagram
+// repeats, so a lost datagram is covered by the next one
+constexpr int kRedundantInputs = 4;
+
+// Socket bound to `port` on all interfaces (server side); -1 on failure
+inline int udpBind(int port) {
+    int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) { perror("udp socket"); return -1; }
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+    if (::bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("udp bind");
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Socket connected to host:port (client side), so send()/recv() only
+// talk to the server; -1 on failure
+inline int udpConnect(const std::string &host, int port) {
+    int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) { perror("udp socket"); return -1; }
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (::inet_pton(AF_INET, host.c_str(), &addr.sin_addr) <= 0 ||
+        ::connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("udp connect");
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Best effort: a full socket buffer or an unreachable peer just loses it
+inline bool udpSend(int fd, const std::string &data) {
+    return ::send(fd, data.data(), data.size(), MSG_DONTWAIT) == (ssize_t)data.size();
+}
+
+inline bool udpSendTo(int fd, const sockaddr_in &to, const std::string &data) {
+    return ::sendto(fd, data.data(), data.size(), MSG_DONTWAIT,
+                    (const sockaddr *)&to, sizeof(to)) == (ssize_t)data.size();
+}
+
+// Drops datagrams with a fixed probability, for testing lossy links on
+// localhost (both directions when applied at one end)
+class LossInjector {
+public:
+    explicit LossInjector(double p = 0.0) : m_p(p), m_rng(std::random_device{}()) {}
+
+    bool drop() {
+        return m_p > 0 && std::uniform_real_distribution<double>(0, 1)(m_rng) < m_p;
+    }
+    double probability() const { return m_p; }
+
+private:
+    double m_p;
+    std::mt19937 m_rng;
+};
+
+#endif
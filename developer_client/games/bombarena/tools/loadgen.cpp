@@ -0,0 +1,561 @@
+// Headless load generator: bots that join game servers, start the match,
+// play a policy and acknowledge snapshots like the real clients, plus
+// optional lobby connections probing request round trips. One thread,
+// one poll() over every socket.
+//
+//   loadgen --games 17000-17049 [--bots 2] [--duration 30]
+//           [--policy random|idle|script:wdsab...] [--action-rate 5]
+//           [--lobby PORT] [--lobby-conns 10] [--lobby-rate 2]
+//           [--host 127.0.0.1] [--pid PID]... [--udp]
+//
+// Every game server in --games gets --bots bots (max_players caps it);
+// the first one to join sends PLAYER_START_GAME once all are in.
+// Reported: input -> ack latency, STATE_UPDATE inter-arrival and jitter
+// against the server's tick, bytes per update, lobby round trips, and
+// CPU of this process and of every --pid. With --udp, bots take the
+// server's UDP offer the way the GUI does (see game_server --udp-loss).
+// Pointed at a spectator_relay, bots only watch: JOIN_GAME gives them no
+// player id, so they never start the match or send inputs.
+
+#include "../shared/tcp.hpp"
+#include "../shared/packet.hpp"
+#include "../shared/udp.hpp"
+#include "../engine/engine.hpp"
+#include "../engine/snapshot.hpp"
+
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace bombarena;
+
+static int64_t nowNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// ---------------------------------------------------------------
+// Sample sets
+// ---------------------------------------------------------------
+
+struct Samples {
+    std::vector<double> v;
+
+    void add(double x) { v.push_back(x); }
+    double pct(double q) {
+        if (v.empty()) return 0;
+        std::sort(v.begin(), v.end());
+        size_t i = std::min(v.size() - 1, (size_t)(q * v.size()));
+        return v[i];
+    }
+    double mean() const {
+        double s = 0;
+        for (double x : v) s += x;
+        return v.empty() ? 0 : s / v.size();
+    }
+    std::string line(const char *unit) {
+        char buf[160];
+        std::snprintf(buf, sizeof(buf), "p50 %.2f%s  p90 %.2f%s  p99 %.2f%s  max %.2f%s  (n=%zu)",
+                      pct(0.50), unit, pct(0.90), unit, pct(0.99), unit, pct(1.0), unit, v.size());
+        return buf;
+    }
+};
+
+// ---------------------------------------------------------------
+// Connections
+// ---------------------------------------------------------------
+
+// A TCPConnection read through poll(): bytes are pulled with MSG_DONTWAIT
+// and split into packet lines here instead of blocking in recvLine()
+struct Link {
+    std::unique_ptr<TCPConnection> conn;
+    std::string inbuf;
+    bool open = false;
+
+    bool connect(const std::string &host, int port) {
+        conn = std::make_unique<TCPConnection>();
+        open = conn->connectToServer(host, port);
+        return open;
+    }
+
+    // Appends complete lines to `lines`; false once the peer is gone
+    bool pump(std::vector<std::string> &lines, uint64_t &bytes) {
+        char buf[65536];
+        while (true) {
+            ssize_t n = ::recv(conn->fd(), buf, sizeof(buf), MSG_DONTWAIT);
+            if (n > 0) {
+                bytes += (uint64_t)n;
+                inbuf.append(buf, (size_t)n);
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if (n < 0 && errno == EINTR) continue;
+            open = false;
+            break;
+        }
+        size_t start = 0, nl;
+        while ((nl = inbuf.find('\n', start)) != std::string::npos) {
+            lines.emplace_back(inbuf, start, nl - start);
+            start = nl + 1;
+        }
+        inbuf.erase(0, start);
+        return open;
+    }
+};
+
+struct Options {
+    std::string host = "127.0.0.1";
+    std::vector<int> gamePorts;
+    int bots = 2;
+    double duration = 30;
+    std::string policy = "random";
+    double actionRate = 5;   // inputs per second per bot
+    int lobbyPort = 0;
+    int lobbyConns = 10;
+    double lobbyRate = 2;    // requests per second per lobby connection
+    std::vector<int> pids;
+    bool udp = false;
+};
+
+struct Bot {
+    int game = 0;
+    Link link;
+    int playerId = -1;      // stays -1 behind a spectator relay
+    bool joined = false;
+    bool host = false;
+    bool started = false;
+    bool ended = false;
+
+    SnapshotReceiver rx;
+    GameState st;
+    double tickMs = 200;
+    int64_t lastUpdateNs = 0;
+
+    struct Input {
+        uint32_t seq;
+        int64_t sentNs;
+        std::string act;
+    };
+    uint32_t nextSeq = 1;
+    std::deque<Input> inflight;   // sent, not yet acked
+    int64_t nextActionNs = 0;
+    size_t scriptPos = 0;
+
+    int udp = -1;
+    uint64_t udpToken = 0;
+    bool udpUp = false;
+    int helloTries = 0;
+    int64_t nextHelloNs = 0;
+};
+
+struct LobbyProbe {
+    Link link;
+    uint32_t nextReq = 1;
+    std::deque<std::pair<uint32_t, int64_t>> inflight;
+    int64_t nextSendNs = 0;
+};
+
+struct Totals {
+    Samples inputLatencyMs;
+    Samples interArrivalMs;
+    Samples jitterMs;      // |inter-arrival - tick|
+    Samples lobbyRttMs;
+    uint64_t updates = 0;
+    uint64_t udpUpdates = 0;
+    uint64_t stateBytes = 0;
+    uint64_t rxBytes = 0;
+    uint64_t inputs = 0;
+    uint64_t resyncs = 0;
+    uint64_t gamesEnded = 0;
+    uint64_t lobbyErrors = 0;
+};
+
+// ---------------------------------------------------------------
+// Bot logic
+// ---------------------------------------------------------------
+
+static const char *kActions[] = {"w", "s", "a", "d", "b"};
+
+static void sendAction(Bot &b, const Options &o, std::mt19937 &rng, Totals &t) {
+    std::string act;
+    if (o.policy == "random") {
+        // Mostly moves; bombs sparingly so matches do not end at once
+        int r = std::uniform_int_distribution<int>(0, 99)(rng);
+        act = kActions[r < 95 ? r % 4 : 4];
+    } else if (o.policy.compare(0, 7, "script:") == 0) {
+        const std::string script = o.policy.substr(7);
+        if (script.empty()) return;
+        act = std::string(1, script[b.scriptPos++ % script.size()]);
+    } else {
+        return;   // idle
+    }
+
+    b.inflight.push_back({b.nextSeq++, nowNs(), act});
+    t.inputs++;
+
+    Packet p;
+    p.type = PacketType::PLAYER_ACTION;
+    if (b.udpUp) {
+        // Same redundancy as the GUI: the newest few unacked inputs
+        p.data["token"] = b.udpToken;
+        p.data["inputs"] = nlohmann::json::array();
+        size_t from = b.inflight.size() > (size_t)kRedundantInputs
+                          ? b.inflight.size() - kRedundantInputs : 0;
+        for (size_t i = from; i < b.inflight.size(); i++)
+            p.data["inputs"].push_back({{"seq", b.inflight[i].seq},
+                                        {"action", b.inflight[i].act}});
+        udpSend(b.udp, p.serialize());
+        return;
+    }
+    p.data["action"] = act;
+    p.data["seq"] = b.inflight.back().seq;
+    b.link.conn->sendPacket(p);
+}
+
+static void sendUdp(Bot &b, Packet &p) {
+    p.data["token"] = b.udpToken;
+    udpSend(b.udp, p.serialize());
+}
+
+static void onBotPacket(Bot &b, const Packet &p, size_t lineBytes, bool viaUdp,
+                        const Options &o, std::vector<Bot> &bots, Totals &t) {
+    const int64_t now = nowNs();
+    switch (p.type) {
+        case PacketType::JOIN_GAME:
+            b.joined   = true;
+            b.playerId = p.data.value("player_id", -1);
+            b.tickMs   = p.data.value("tick_ms", 200.0);
+            b.st       = arenaFromJoin(p.data);
+            if (o.udp && p.data.contains("udp_port") && b.udp < 0) {
+                b.udp = udpConnect(o.host, p.data.value("udp_port", 0));
+                b.udpToken = p.data.value("udp_token", (uint64_t)0);
+            }
+            break;
+
+        case PacketType::UDP_HELLO:
+            b.udpUp = true;
+            break;
+
+        case PacketType::PLAYER_START_GAME:
+            b.started = true;
+            break;
+
+        case PacketType::STATE_UPDATE: {
+            b.started = true;
+            t.updates++;
+            if (viaUdp) t.udpUpdates++;
+            t.stateBytes += lineBytes;
+            if (b.lastUpdateNs) {
+                double dt = (now - b.lastUpdateNs) / 1e6;
+                t.interArrivalMs.add(dt);
+                t.jitterMs.add(std::fabs(dt - b.tickMs));
+            }
+            b.lastUpdateNs = now;
+
+            bool applied = b.rx.apply(p.data, b.st);
+            if (!applied) t.resyncs++;
+
+            Packet ack;
+            ack.type = PacketType::STATE_ACK;
+            ack.data["turn"] = b.rx.lastTurn();
+            if (!applied) ack.data["keyframe"] = true;
+            if (viaUdp) sendUdp(b, ack);
+            else        b.link.conn->sendPacket(ack);
+
+            uint32_t acked = 0;
+            if (p.data.contains("acks"))
+                for (auto &a : p.data["acks"])
+                    if (a.value("id", -1) == b.playerId)
+                        acked = a.value("seq", 0u);
+            while (!b.inflight.empty() && b.inflight.front().seq <= acked) {
+                t.inputLatencyMs.add((now - b.inflight.front().sentNs) / 1e6);
+                b.inflight.pop_front();
+            }
+            break;
+        }
+
+        case PacketType::GAME_END:
+            if (!b.ended) t.gamesEnded++;   // first bot of the game to see it
+            b.ended = true;
+            for (auto &o : bots)
+                if (o.game == b.game) o.ended = true;
+            break;
+
+        default:
+            break;
+    }
+}
+
+// ---------------------------------------------------------------
+// CPU accounting
+// ---------------------------------------------------------------
+
+static double selfCpuSec() {
+    rusage ru{};
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+           ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+// utime + stime of another process, -1 if it is gone
+static double pidCpuSec(int pid) {
+    std::ifstream f("/proc/" + std::to_string(pid) + "/stat");
+    std::string s;
+    if (!std::getline(f, s)) return -1;
+    size_t rp = s.rfind(')');   // the command name may contain spaces
+    if (rp == std::string::npos) return -1;
+    std::istringstream in(s.substr(rp + 2));
+    std::string field;
+    unsigned long long ut = 0, st = 0;
+    for (int i = 3; i <= 15 && in >> field; i++) {
+        if (i == 14) ut = std::stoull(field);
+        if (i == 15) st = std::stoull(field);
+    }
+    return (double)(ut + st) / sysconf(_SC_CLK_TCK);
+}
+
+// ---------------------------------------------------------------
+// main
+// ---------------------------------------------------------------
+
+static bool parsePorts(const std::string &spec, std::vector<int> &out) {
+    std::stringstream ss(spec);
+    std::string part;
+    while (std::getline(ss, part, ',')) {
+        size_t dash = part.find('-');
+        int a = std::stoi(part.substr(0, dash));
+        int b = (dash == std::string::npos) ? a : std::stoi(part.substr(dash + 1));
+        if (a <= 0 || b < a) return false;
+        for (int p = a; p <= b; p++) out.push_back(p);
+    }
+    return !out.empty();
+}
+
+int main(int argc, char **argv) {
+    Options o;
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string a = argv[i];
+            auto val = [&]() -> std::string {
+                if (i + 1 >= argc) throw std::runtime_error("missing value for " + a);
+                return argv[++i];
+            };
+            if      (a == "--games")       { if (!parsePorts(val(), o.gamePorts)) throw std::runtime_error("bad --games"); }
+            else if (a == "--bots")        o.bots = std::stoi(val());
+            else if (a == "--duration")    o.duration = std::stod(val());
+            else if (a == "--policy")      o.policy = val();
+            else if (a == "--action-rate") o.actionRate = std::stod(val());
+            else if (a == "--lobby")       o.lobbyPort = std::stoi(val());
+            else if (a == "--lobby-conns") o.lobbyConns = std::stoi(val());
+            else if (a == "--lobby-rate")  o.lobbyRate = std::stod(val());
+            else if (a == "--host")        o.host = val();
+            else if (a == "--pid")         o.pids.push_back(std::stoi(val()));
+            else if (a == "--udp")         o.udp = true;
+            else throw std::runtime_error("unknown option " + a);
+        }
+    } catch (std::exception &e) {
+        std::cerr << "loadgen: " << e.what() << "\n";
+        return 1;
+    }
+    if (o.gamePorts.empty() && !o.lobbyPort) {
+        std::cerr << "loadgen: nothing to do (need --games and/or --lobby)\n";
+        return 1;
+    }
+    if (o.policy != "random" && o.policy != "idle" && o.policy.compare(0, 7, "script:") != 0) {
+        std::cerr << "loadgen: unknown policy " << o.policy << "\n";
+        return 1;
+    }
+
+    std::mt19937 rng(12345);
+    Totals t;
+    const int64_t t0 = nowNs();
+    const double cpu0 = selfCpuSec();
+    std::vector<double> pidCpu0;
+    for (int pid : o.pids) pidCpu0.push_back(pidCpuSec(pid));
+
+    // Connect everything up front
+    std::vector<Bot> bots(o.gamePorts.size() * o.bots);
+    for (size_t g = 0; g < o.gamePorts.size(); g++) {
+        for (int k = 0; k < o.bots; k++) {
+            Bot &b = bots[g * o.bots + k];
+            b.game = (int)g;
+            b.host = (k == 0);
+            b.st = initTwoPlayerDefault();
+            if (!b.link.connect(o.host, o.gamePorts[g]))
+                std::cerr << "loadgen: game port " << o.gamePorts[g] << " refused bot " << k << "\n";
+        }
+    }
+    std::vector<LobbyProbe> lobby(o.lobbyPort ? o.lobbyConns : 0);
+    for (auto &l : lobby)
+        l.link.connect(o.host, o.lobbyPort);
+
+    const int64_t actionGap = o.actionRate > 0 ? (int64_t)(1e9 / o.actionRate) : 0;
+    const int64_t lobbyGap  = o.lobbyRate  > 0 ? (int64_t)(1e9 / o.lobbyRate)  : 0;
+    const int64_t endNs = t0 + (int64_t)(o.duration * 1e9);
+
+    std::vector<pollfd> pfds;
+    std::vector<std::string> lines;
+
+    while (nowNs() < endNs) {
+        const int64_t now = nowNs();
+
+        // Hosts start their game once every bot of it has a player id
+        for (auto &b : bots) {
+            if (!b.host || b.started || !b.link.open) continue;
+            bool allIn = true;
+            for (auto &o2 : bots)
+                if (o2.game == b.game && o2.link.open && o2.playerId < 0) allIn = false;
+            if (allIn && b.playerId >= 0) {
+                Packet s;
+                s.type = PacketType::PLAYER_START_GAME;
+                b.link.conn->sendPacket(s);
+                b.started = true;   // the server's broadcast confirms it
+            }
+        }
+
+        // Inputs, staggered by bot so they do not all land together
+        for (size_t i = 0; i < bots.size(); i++) {
+            Bot &b = bots[i];
+            if (!b.link.open || !b.started || b.ended || b.playerId < 0 || !actionGap) continue;
+            if (!b.nextActionNs) b.nextActionNs = now + (int64_t)(i * 7919 % 1000) * actionGap / 1000;
+            if (now >= b.nextActionNs) {
+                sendAction(b, o, rng, t);
+                b.nextActionNs += actionGap;
+            }
+        }
+
+        // UDP hello until answered (then as keepalive); give up after 2 s
+        for (auto &b : bots) {
+            if (b.udp < 0 || now < b.nextHelloNs) continue;
+            if (!b.udpUp && b.helloTries++ == 8) {
+                ::close(b.udp);
+                b.udp = -1;
+                continue;
+            }
+            Packet h;
+            h.type = PacketType::UDP_HELLO;
+            sendUdp(b, h);
+            b.nextHelloNs = now + (b.udpUp ? 500 : 250) * 1000000LL;
+        }
+
+        for (auto &l : lobby) {
+            if (!l.link.open || !lobbyGap || now < l.nextSendNs) continue;
+            Packet p;
+            p.type = PacketType::PLAYER_LIST_GAMES;
+            p.reqId = l.nextReq++;
+            l.inflight.emplace_back(p.reqId, now);
+            l.link.conn->sendPacket(p);
+            l.nextSendNs = now + lobbyGap;
+        }
+
+        pfds.clear();
+        for (auto &b : bots) {
+            if (b.link.open) pfds.push_back({b.link.conn->fd(), POLLIN, 0});
+            if (b.udp >= 0)  pfds.push_back({b.udp, POLLIN, 0});
+        }
+        for (auto &l : lobby)
+            if (l.link.open) pfds.push_back({l.link.conn->fd(), POLLIN, 0});
+        if (pfds.empty()) break;
+
+        ::poll(pfds.data(), pfds.size(), 2);
+
+        for (auto &b : bots) {
+            if (!b.link.open) continue;
+            lines.clear();
+            b.link.pump(lines, t.rxBytes);
+            for (auto &line : lines) {
+                try {
+                    onBotPacket(b, Packet::deserialize(line), line.size() + 1, false, o, bots, t);
+                } catch (std::exception &) {}
+            }
+            char dgram[65536];
+            ssize_t n;
+            while (b.udp >= 0 && (n = ::recv(b.udp, dgram, sizeof(dgram), MSG_DONTWAIT)) > 0) {
+                t.rxBytes += (uint64_t)n;
+                try {
+                    onBotPacket(b, Packet::deserialize(std::string(dgram, (size_t)n)),
+                                (size_t)n, true, o, bots, t);
+                } catch (std::exception &) {}
+            }
+        }
+        for (auto &l : lobby) {
+            if (!l.link.open) continue;
+            lines.clear();
+            l.link.pump(lines, t.rxBytes);
+            for (auto &line : lines) {
+                try {
+                    Packet p = Packet::deserialize(line);
+                    auto it = std::find_if(l.inflight.begin(), l.inflight.end(),
+                                           [&](const std::pair<uint32_t, int64_t> &e) { return e.first == p.reqId; });
+                    if (it == l.inflight.end()) continue;
+                    t.lobbyRttMs.add((nowNs() - it->second) / 1e6);
+                    if (!p.data.value("ok", true)) t.lobbyErrors++;
+                    l.inflight.erase(it);
+                } catch (std::exception &) {}
+            }
+        }
+
+        // Every game over and no lobby work left: stop early
+        bool anyLive = !lobby.empty();
+        for (auto &b : bots)
+            if (b.link.open && !b.ended) anyLive = true;
+        if (!anyLive) break;
+    }
+
+    const double wall = (nowNs() - t0) / 1e9;
+    const double cpu = selfCpuSec() - cpu0;
+
+    size_t connected = 0;
+    for (auto &b : bots) if (b.joined) connected++;
+
+    std::printf("loadgen: %.1f s, %zu game ports, %zu/%zu bots joined, %llu games ended, policy %s\n",
+                wall, o.gamePorts.size(), connected, bots.size(),
+                (unsigned long long)t.gamesEnded, o.policy.c_str());
+    if (!bots.empty()) {
+        std::printf("  state updates      %llu, %.1f bytes/update, %.1f KiB/s received\n",
+                    (unsigned long long)t.updates,
+                    t.updates ? (double)t.stateBytes / t.updates : 0.0,
+                    t.rxBytes / 1024.0 / wall);
+        std::printf("  inter-arrival      mean %.2f ms, %s\n", t.interArrivalMs.mean(),
+                    t.interArrivalMs.line("ms").c_str());
+        std::printf("  jitter vs tick     %s\n", t.jitterMs.line("ms").c_str());
+        long desyncs = 0;
+        for (auto &b : bots) desyncs += b.rx.desyncs();
+        std::printf("  input -> ack       %s  (%llu sent, %llu keyframe resyncs, %ld hash mismatches)\n",
+                    t.inputLatencyMs.line("ms").c_str(),
+                    (unsigned long long)t.inputs, (unsigned long long)t.resyncs, desyncs);
+    }
+    if (o.udp) {
+        size_t up = 0;
+        for (auto &b : bots) if (b.udpUp) up++;
+        std::printf("  udp                %zu/%zu bots, %.1f%% of updates by datagram\n",
+                    up, bots.size(), t.updates ? 100.0 * t.udpUpdates / t.updates : 0.0);
+    }
+    if (!lobby.empty())
+        std::printf("  lobby round trip   %s  (%llu errors)\n",
+                    t.lobbyRttMs.line("ms").c_str(), (unsigned long long)t.lobbyErrors);
+
+    std::printf("  cpu                loadgen %.1f%%", 100.0 * cpu / wall);
+    for (size_t i = 0; i < o.pids.size(); i++) {
+        double c = pidCpuSec(o.pids[i]);
+        if (c < 0 || pidCpu0[i] < 0) std::printf(", pid %d gone", o.pids[i]);
+        else std::printf(", pid %d %.1f%%", o.pids[i], 100.0 * (c - pidCpu0[i]) / wall);
+    }
+    std::printf("\n");
+    return 0;
+}
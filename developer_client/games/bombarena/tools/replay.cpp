@@ -0,0 +1,142 @@
+// Re-runs a recorded match (game_server --record) through step().
+//
+//   replay FILE                 check that the engine reproduces the match
+//   replay FILE --bench N       ... then time N more full replays
+//   replay FILE --render [--speed X]
+//                               print the board every turn, at X times the
+//                               recorded tick rate (0 = as fast as possible)
+//
+// Exits 1 if a checksum or the result differs from the recording, or the
+// state hash step() keeps up to date drifts from a full recompute.
+
+#include "../engine/engine.hpp"
+#include "../engine/replay.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+
+using namespace bombarena;
+
+static const char *resultName(const GameResult &r) {
+    switch (r.type) {
+        case GameResultType::PlayerWin: return "win";
+        case GameResultType::Draw:      return "draw";
+        default:                        return "ongoing";
+    }
+}
+
+// One pass over the log. Returns false on the first divergence.
+static bool playOnce(ReplayReader &rd, const GameState &initial, bool verify,
+                     bool render, double speed, long &ticks) {
+    GameState st = initial;
+    GameResult res;
+    ReplayRecord rec;
+    bool ended = false;
+    ticks = 0;
+
+    const auto period = std::chrono::duration<double>(
+        speed > 0 ? 1.0 / (rd.tickHz() * speed) : 0.0);
+
+    rd.rewind();
+    while (rd.next(rec)) {
+        switch (rec.tag) {
+            case ReplayTag::Tick:
+                res = step(st, rec.actions);
+                ticks++;
+                if (render) {
+                    std::cout << "\x1b[H\x1b[2J" << renderBoard(st) << std::flush;
+                    if (period.count() > 0) std::this_thread::sleep_for(period);
+                }
+                break;
+
+            case ReplayTag::Checksum:
+                if (verify && (st.turnNumber != rec.turn || stateChecksum(st) != rec.checksum)) {
+                    std::printf("DIVERGED at turn %d (recorded checksum turn %d)\n",
+                                st.turnNumber, rec.turn);
+                    return false;
+                }
+                if (verify && st.hash != computeStateHash(st)) {
+                    std::printf("HASH DRIFT at turn %d: incremental %016llx, recomputed %016llx\n",
+                                st.turnNumber, (unsigned long long)st.hash,
+                                (unsigned long long)computeStateHash(st));
+                    return false;
+                }
+                break;
+
+            case ReplayTag::End:
+                ended = true;
+                if (verify && (st.turnNumber != rec.turn || stateChecksum(st) != rec.checksum ||
+                               res.type != rec.result.type || res.winnerId != rec.result.winnerId)) {
+                    std::printf("DIVERGED at end: replayed %s/%d turn %d, recorded %s/%d turn %d\n",
+                                resultName(res), res.winnerId, st.turnNumber,
+                                resultName(rec.result), rec.result.winnerId, rec.turn);
+                    return false;
+                }
+                if (verify)
+                    std::printf("result %s, winner %d, turn %d\n",
+                                resultName(res), res.winnerId, st.turnNumber);
+                break;
+        }
+    }
+
+    if (rd.truncated())
+        std::printf("warning: log is truncated after %ld ticks\n", ticks);
+    else if (verify && !ended)
+        std::printf("note: no result recorded (match unfinished)\n");
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: replay FILE [--bench N] [--render] [--speed X]\n";
+        return 1;
+    }
+
+    std::string path = argv[1];
+    long benchRuns = 0;
+    bool render = false;
+    double speed = 1.0;
+
+    for (int i = 2; i < argc; i++) {
+        std::string a = argv[i];
+        if (a == "--bench" && i + 1 < argc)      benchRuns = std::stol(argv[++i]);
+        else if (a == "--render")                render = true;
+        else if (a == "--speed" && i + 1 < argc) speed = std::stod(argv[++i]);
+        else {
+            std::cerr << "unknown option " << a << "\n";
+            return 1;
+        }
+    }
+
+    ReplayReader rd;
+    GameState initial;
+    std::string err;
+    if (!rd.open(path, initial, err)) {
+        std::cerr << "replay: " << err << "\n";
+        return 1;
+    }
+
+    std::printf("%s: %dx%d, %zu players, %d Hz\n", path.c_str(),
+                initial.width, initial.height, initial.players.size(), rd.tickHz());
+
+    long ticks = 0;
+    if (!playOnce(rd, initial, true, render, speed, ticks))
+        return 1;
+    std::printf("deterministic: OK (%ld ticks)\n", ticks);
+
+    if (benchRuns > 0) {
+        auto t0 = std::chrono::steady_clock::now();
+        long total = 0;
+        for (long r = 0; r < benchRuns; r++) {
+            playOnce(rd, initial, false, false, 0, ticks);
+            total += ticks;
+        }
+        double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        std::printf("bench: %ld replays, %.0f ticks/s, %.2f us/tick\n",
+                    benchRuns, total / sec, sec * 1e6 / total);
+    }
+    return 0;
+}
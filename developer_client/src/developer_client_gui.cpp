@@ -5,6 +5,7 @@
 #include "./shared/packet.hpp"
 #include "./shared/protocol.hpp"
 #include "./base64.hpp"
+#include "./sha256.hpp"
 
 #include <fstream>
 #include <iostream>
@@ -165,6 +166,16 @@ private:
                 m_statusText = "Register successful. Now you can login.";
             }
         }
+        else if (kind == "DEV_UPLOAD_ACCEPTED") {
+            m_statusText =
+                "Upload received (job " +
+                std::to_string(d.value("job_id", 0)) + "), processing...";
+        }
+        else if (kind == "DEV_UPLOAD_PROGRESS") {
+            m_statusText =
+                "Job " + std::to_string(d.value("job_id", 0)) + ": " +
+                d.value("stage", std::string("?")) + "...";
+        }
         else if (kind == "DEV_UPLOAD_GAME") {
             m_statusText =
                 "Upload OK! game_id=" +
@@ -280,6 +291,7 @@ private:
         p.data["version_str"]   = (m_newVersion.empty() ? "v1.0" : m_newVersion);
         p.data["filename"]      = "game.zip";
         p.data["filedata_base64"] = b64;
+        p.data["sha256"]        = sha256Hex(raw);
 
         if (!m_conn.sendPacket(p)) {
             m_statusText = "Failed to send upload (new game).";
@@ -315,6 +327,7 @@ private:
         p.data["version_str"]   = m_upVersion;
         p.data["filename"]      = "game.zip";
         p.data["filedata_base64"] = b64;
+        p.data["sha256"]        = sha256Hex(raw);
 
         if (!m_conn.sendPacket(p)) {
             m_statusText = "Failed to send upload (update).";
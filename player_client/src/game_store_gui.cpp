@@ -8,6 +8,8 @@
 #include <vector>
 #include <string>
 #include <optional>
+#include <functional>
+#include <unordered_map>
 #include <filesystem>
 #include <cctype>
 #include <cstdlib>
@@ -93,22 +95,6 @@ bool checkInstalled(int playerId, int gameId, std::string &outDir) {
     return false;
 }
 
-bool unzipFileWithSystem(const std::string &zipPath, const std::string &outputDir)
-{
-    std::string cmd = "unzip -o \"" + zipPath + "\" -d \"" + outputDir + "\"";
-    int code = std::system(cmd.c_str());
-    return (code == 0);
-}
-
-static void markExecutablesInDir(const std::string &dirPath) {
-    namespace fs = std::filesystem;
-    if (!fs::exists(dirPath)) return;
-    for (auto &entry : fs::directory_iterator(dirPath)) {
-        if (!entry.is_regular_file()) continue;
-        const std::string p = entry.path().string();
-        ::chmod(p.c_str(), 0755);
-    }
-}
 static std::string readVersionFile(const std::string &installDir) {
     std::string path = installDir + "/version.txt";
     if (!std::filesystem::exists(path)) return "";
@@ -184,6 +170,8 @@ private:
         Password
     };
 
+    using ReplyHandler = std::function<void(const Packet&)>;
+
     void sendPlayerLogin() {
         if (m_loginUser.empty() || m_loginPass.empty()) {
             m_statusMessage = "Username and password required.";
@@ -195,7 +183,7 @@ private:
         p.type = PacketType::PLAYER_LOGIN;
         p.data["username"] = m_loginUser;
         p.data["password"] = m_loginPass;
-        m_conn.sendPacket(p);
+        sendRequest(p, [this](const Packet &r) { handlePlayerLogin(r.data); });
 
         m_statusMessage = "Logging in...";
         m_statusIsError = false;
@@ -213,7 +201,7 @@ private:
         p.type = PacketType::PLAYER_REGISTER;
         p.data["username"] = m_loginUser;
         p.data["password"] = m_loginPass;
-        m_conn.sendPacket(p);
+        sendRequest(p, [this](const Packet &r) { handlePlayerLogin(r.data); });
 
         m_statusMessage = "Registering account...";
         m_statusIsError = false;
@@ -260,26 +248,28 @@ private:
         int fd = m_conn.fd();
         if (fd < 0) return;
 
-        fd_set readfds;
-        FD_ZERO(&readfds);
-        FD_SET(fd, &readfds);
+        // Drain every reply that is already here, not one per frame, so
+        // pipelined responses do not queue up behind the render loop
+        for (int budget = 64; budget > 0 && m_running; --budget) {
+            fd_set readfds;
+            FD_ZERO(&readfds);
+            FD_SET(fd, &readfds);
 
-        timeval tv;
-        tv.tv_sec = 0;
-        tv.tv_usec = 0; 
+            timeval tv;
+            tv.tv_sec = 0;
+            tv.tv_usec = 0; 
 
-        int ret = select(fd + 1, &readfds, nullptr, nullptr, &tv);
-        if (ret < 0) {
-            perror("select");
-            m_running = false;
-            return;
-        }
+            int ret = select(fd + 1, &readfds, nullptr, nullptr, &tv);
+            if (ret < 0) {
+                perror("select");
+                m_running = false;
+                return;
+            }
 
-        if (ret == 0) {
-            return;
-        }
+            if (ret == 0 || !FD_ISSET(fd, &readfds)) {
+                return;
+            }
 
-        if (FD_ISSET(fd, &readfds)) {
             Packet p;
             if (!m_conn.recvPacket(p)) {
                 std::cerr << "[GUI] Disconnected from store server\n";
@@ -290,7 +280,43 @@ private:
         }
     }
 
+    // Sends p with a fresh req_id; onReply runs when the echoed reply
+    // arrives, whatever order the server completes requests in.
+    void sendRequest(Packet &p, ReplyHandler onReply) {
+        p.reqId = m_nextReqId++;
+        if (m_nextReqId == 0) m_nextReqId = 1;
+        m_pendingReplies[p.reqId] = std::move(onReply);
+        m_conn.sendPacket(p);
+    }
+
+    // Shared error handling for replies; false if the request failed
+    bool replyOk(const Packet &p) {
+        const auto &d = p.data;
+        if (p.type == PacketType::ERROR_RESPONSE || !d.value("ok", true)) {
+            std::string msg = d.value("msg",
+                              d.value("message",
+                                      std::string("Request failed")));
+            m_statusMessage = msg;
+            m_statusIsError = true;
+            std::cerr << "[GUI] request " << p.reqId << " failed: " << msg << "\n";
+            return false;
+        }
+        return true;
+    }
+
     void handlePacket(const Packet &p) {
+        if (p.reqId != 0) {
+            auto it = m_pendingReplies.find(p.reqId);
+            if (it != m_pendingReplies.end()) {
+                ReplyHandler h = std::move(it->second);
+                m_pendingReplies.erase(it);
+                h(p);
+                return;
+            }
+        }
+
+        // Pushes (and servers that do not echo req_id) are recognised
+        // by their fields
         const auto &d = p.data;
         //std::cout<<d.value("kind",":)")<<"\n";
         // First, detect login/register success response
@@ -336,7 +362,9 @@ private:
         if (d.contains("games")) {
             handleGameList(d);
         } else if (d.contains("filedata_base64")) {
-            handleGameDownload(d);
+            if (m_selectedGameIndex >= 0 &&
+                m_selectedGameIndex < static_cast<int>(m_games.size()))
+                handleGameDownload(d, m_games[m_selectedGameIndex].id);
         } else if (d.contains("server_port") && d.contains("game_id")) {
             std::cout<<"startinggamereponse\n";
             handleStartGameResponse(d);
@@ -376,6 +404,21 @@ private:
         std::cout << "[GUI] Received " << m_games.size() << " game(s) from server\n";
     }
 
+    //REVIEWS
+    void handleReviews(int gameId, const nlohmann::json &d) {
+        auto &cached = m_reviewsByGame[gameId];
+        cached.clear();
+        if (d.contains("reviews"))
+            for (auto &r : d["reviews"])
+                cached.push_back(r);
+
+        if (m_selectedGameIndex >= 0 &&
+            m_selectedGameIndex < static_cast<int>(m_games.size()) &&
+            m_games[m_selectedGameIndex].id == gameId) {
+            m_currentReviews = cached;
+        }
+    }
+
     //ROOM INFO 
     void handleRoomInfo(const nlohmann::json &d) {
         RoomInfo info;
@@ -404,17 +447,22 @@ private:
     }
 
     //GAME DOWNLOAD
-    void handleGameDownload(const nlohmann::json &d) {
-        if (m_selectedGameIndex < 0 ||
-            m_selectedGameIndex >= static_cast<int>(m_games.size())) {
-            m_statusMessage = "Download result but no selected game?";
+    void handleGameDownload(const nlohmann::json &d, int gameId) {
+        GameInfo *target = nullptr;
+        for (auto &gi : m_games) {
+            if (gi.id == gameId) {
+                target = &gi;
+                break;
+            }
+        }
+        if (!target) {
+            m_statusMessage = "Download result for an unknown game?";
             m_statusIsError = true;
             return;
         }
 
-        auto &game = m_games[m_selectedGameIndex];
+        auto &game = *target;
 
-        std::string filename = d.value("filename", std::string("game.zip"));
         std::string b64      = d.value("filedata_base64", std::string(""));
         std::string version  = d.value("version", std::string(""));
 
@@ -443,7 +491,9 @@ private:
             return;
         }
 
-        std::string zipPath = installDir + "/" + filename;
+        // Next to the install folder, not in it, so no entry can land on
+        // the archive being extracted; gone again once it is unpacked
+        std::string zipPath = installDir + ".download.zip";
         if (!writeBinaryFile(zipPath, raw)) {
             m_statusMessage = "Failed to write game zip.";
             m_statusIsError = true;
@@ -453,19 +503,16 @@ private:
         m_statusMessage = "Unzipping game package...";
         m_statusIsError = false;
 
-        std::string cmd =
-            "unzip -o \"" + zipPath + "\" -d \"" + installDir + "\" > /dev/null 2>&1";
-
-        int code = std::system(cmd.c_str());
-        if (code != 0) {
+        bool unzipped = unzipToDir(zipPath, installDir);
+        std::error_code ec;
+        std::filesystem::remove(zipPath, ec);
+        if (!unzipped) {
             m_statusMessage = "Failed to unzip game package.";
             m_statusIsError = true;
-            std::cerr << "[GUI] unzip command failed: " << cmd << "\n";
+            std::cerr << "[GUI] failed to extract " << zipPath << "\n";
             return;
         }
 
-        markExecutablesInDir(installDir + "/server");
-        markExecutablesInDir(installDir + "/client");
         std::string vpath = installDir + "/version.txt";
         std::ofstream vf(vpath);
         vf << version;
@@ -489,6 +536,7 @@ private:
         int gameId = d.value("game_id", -1);
         int port   = d.value("server_port", 0);
         std::string is_host = d.value("is_host","0");
+        std::string seat    = d.value("seat_token", "");   // our seat in the match
         std::cout<<"starting game on port: "<<port<<"\n";
         if (gameId < 0 || port <= 0) {
             m_statusMessage = "Invalid start-game response.";
@@ -547,6 +595,7 @@ private:
                 m_host.c_str(),
                 std::to_string(port).c_str(),
                 is_host.c_str(),
+                seat.c_str(),
                 (char*)NULL);
 
             _exit(1);
@@ -559,11 +608,28 @@ private:
     void requestGameList() {
         Packet p;
         p.type = PacketType::PLAYER_LIST_GAMES;
-        m_conn.sendPacket(p);
+        sendRequest(p, [this](const Packet &r) {
+            if (!replyOk(r)) return;
+            handleGameList(r.data);
+
+            // Pipeline the reviews of every listed game on this connection
+            for (auto &g : m_games)
+                if (g.id > 0) requestReviews(g.id);
+        });
         m_statusMessage = "Requested game list from server...";
         m_statusIsError = false;
     }
 
+    void requestReviews(int gameId) {
+        Packet p;
+        p.type = PacketType::PLAYER_GET_REVIEWS;
+        p.data["game_id"] = gameId;
+        sendRequest(p, [this, gameId](const Packet &r) {
+            if (!replyOk(r)) return;
+            handleReviews(gameId, r.data);
+        });
+    }
+
     void downloadSelectedGame() {
         if (m_selectedGameIndex < 0 ||
             m_selectedGameIndex >= static_cast<int>(m_games.size())) {
@@ -581,7 +647,14 @@ private:
         Packet p;
         p.type = PacketType::PLAYER_DOWNLOAD_GAME;
         p.data["game_id"] = g.id;
-        m_conn.sendPacket(p);
+        int gameId = g.id;
+        sendRequest(p, [this, gameId](const Packet &r) {
+            if (!replyOk(r)) {
+                m_isDownloading = false;
+                return;
+            }
+            handleGameDownload(r.data, gameId);
+        });
 
         m_isDownloading = true;
         m_statusMessage = "Downloading '" + g.name + "' from server...";
@@ -612,7 +685,9 @@ private:
         p.type = PacketType::PLAYER_CREATE_ROOM;
         p.data["game_id"]   = g.id;
         p.data["player_id"] = m_playerId;
-        m_conn.sendPacket(p);
+        sendRequest(p, [this](const Packet &r) {
+            if (replyOk(r)) handleRoomInfo(r.data);
+        });
 
         m_lastRoomHostFlag = true;
         m_statusMessage = "Creating room for '" + g.name + "'...";
@@ -651,7 +726,9 @@ private:
             return;
         }
         p.data["player_id"] = m_playerId;
-        m_conn.sendPacket(p);
+        sendRequest(p, [this](const Packet &r) {
+            if (replyOk(r)) handleRoomInfo(r.data);
+        });
 
         m_lastRoomHostFlag = false;
         m_statusMessage = "Joining room " + roomCode + "...";
@@ -679,7 +756,10 @@ private:
         //std::cout<<"sendStartGame stoi fin\n";
         p.data["player_id"] = m_playerId;
 
-        m_conn.sendPacket(p);
+        // Other room members get the same START_GAME as an untagged push
+        sendRequest(p, [this](const Packet &r) {
+            if (replyOk(r)) handleStartGameResponse(r.data);
+        });
 
         m_statusMessage = "Requested game start for room " + m_room->roomId + "...";
         m_statusIsError = false;
@@ -705,17 +785,18 @@ private:
         p.data["score"]     = m_reviewScore;
         p.data["comment"]  = m_reviewText;
 
-        m_conn.sendPacket(p);
+        sendRequest(p, [this](const Packet &r) {
+            if (!replyOk(r)) return;
+            m_statusMessage = "Review submitted.";
+            m_statusIsError = false;
+        });
 
         m_statusMessage = "Submitting review...";
         m_statusIsError = false;
 
         m_reviewBoxOpen = false;
 
-        Packet q;
-        q.type = PacketType::PLAYER_GET_REVIEWS;
-        q.data["game_id"] = m_games[m_selectedGameIndex].id;
-        m_conn.sendPacket(q);
+        requestReviews(m_games[m_selectedGameIndex].id);
 
     }
 
@@ -831,10 +912,13 @@ private:
                 if (cardArea.contains(mouse)) {
                     m_selectedGameIndex = i;
 
-                    Packet p;
-                    p.type = PacketType::PLAYER_GET_REVIEWS;
-                    p.data["game_id"] = m_games[i].id;
-                    m_conn.sendPacket(p);
+                    // Show the prefetched copy now, refresh in background
+                    auto cached = m_reviewsByGame.find(m_games[i].id);
+                    if (cached != m_reviewsByGame.end())
+                        m_currentReviews = cached->second;
+                    else
+                        m_currentReviews.clear();
+                    requestReviews(m_games[i].id);
 
                     return;
                 }
@@ -1513,6 +1597,11 @@ private:
     int         m_reviewScore   = 5;
     std::string m_reviewText;
     std::vector<json> m_currentReviews;
+    std::unordered_map<int, std::vector<json>> m_reviewsByGame;
+
+    // Outstanding requests by req_id
+    uint32_t m_nextReqId = 1;
+    std::unordered_map<uint32_t, ReplyHandler> m_pendingReplies;
     sf::RectangleShape m_refreshButton;
 
 
@@ -5,25 +5,73 @@
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
 #include <iostream>
 #include <functional>
 #include <thread>
 #include <atomic>
 #include <cerrno>
+#include <condition_variable>
+#include <vector>
+#include <memory>
+#include <mutex>
 
 #include "packet.hpp"
 
+// The request a thread is currently answering, and on which connection.
+// A server sets it around a handler call; sendPacket() on that same
+// connection then echoes the request id in the reply.
+class ReplyScope {
+public:
+    ReplyScope(const void *conn, uint32_t reqId) : m_prev(current()) {
+        current() = Context{conn, reqId};
+    }
+    ~ReplyScope() { current() = m_prev; }
+
+    ReplyScope(const ReplyScope &) = delete;
+    ReplyScope &operator=(const ReplyScope &) = delete;
+
+    static uint32_t reqIdFor(const void *conn) {
+        const Context &c = current();
+        return (c.conn == conn) ? c.reqId : 0;
+    }
+
+private:
+    struct Context {
+        const void *conn  = nullptr;
+        uint32_t    reqId = 0;
+    };
+
+    static Context &current() {
+        static thread_local Context ctx;
+        return ctx;
+    }
+
+    Context m_prev;
+};
+
+
+// One encoded packet line. Immutable once built, so a single encoding can
+// be handed to any number of connections.
+using SharedBuffer = std::shared_ptr<const std::string>;
 
-class TCPConnection {
+inline SharedBuffer encodePacket(const Packet &p) {
+    return std::make_shared<const std::string>(p.serialize());
+}
+
+// Servers hold connections in shared_ptrs; shared_from_this() lets work
+// that outlives a handler call keep a weak reference for later replies.
+class TCPConnection : public std::enable_shared_from_this<TCPConnection> {
     int sock;
+    std::mutex m_sendMutex;   // one writer at a time per socket
 
 public:
     void *owner;   
 
     TCPConnection() : sock(-1), owner(nullptr) {}
     explicit TCPConnection(int existingSock)
-        : sock(existingSock), owner(nullptr) {}
+        : sock(existingSock), owner(nullptr) { setNoDelay(); }
 
     TCPConnection(const TCPConnection &) = delete;
     TCPConnection &operator=(const TCPConnection &) = delete;
@@ -79,18 +127,41 @@ public:
             sock = -1;
             return false;
         }
+        setNoDelay();
         return true;
     }
 
+    // Packets are small and latency-bound; without this a write that
+    // follows an unacknowledged one waits for the peer's delayed ACK
+    void setNoDelay() {
+        int one = 1;
+        if (sock >= 0)
+            ::setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
     bool sendPacket(const Packet &p) {
-        std::string out = p.serialize();
+        std::string out = p.serialize(ReplyScope::reqIdFor(this));
         if (out.empty() || out.back() != '\n')
             out.push_back('\n');
 
-        ssize_t sent = ::send(sock, out.c_str(), out.size(), 0);
-        if (sent != (ssize_t)out.size()) {
-            perror("send");
-            return false;
+        return sendAll(out.data(), out.size());
+    }
+
+    bool sendBuffer(const SharedBuffer &buf) {
+        return buf && sendAll(buf->data(), buf->size());
+    }
+
+    bool sendAll(const char *data, size_t len) {
+        std::lock_guard<std::mutex> lk(m_sendMutex);
+        while (len > 0) {
+            ssize_t n = ::send(sock, data, len, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                perror("send");
+                return false;
+            }
+            data += n;
+            len  -= (size_t)n;
         }
         return true;
     }
@@ -132,6 +203,88 @@ public:
 };
 
 
+// Outbound queue for one connection, drained by its own writer thread so a
+// broadcaster never waits on a slow socket. If more than maxPending
+// buffers back up, the backlog is dropped and push() reports it; the
+// caller decides how the peer resynchronises.
+class SendQueue {
+public:
+    explicit SendQueue(std::shared_ptr<TCPConnection> conn, size_t maxPending = 64)
+        : m_conn(std::move(conn)), m_ring(maxPending ? maxPending : 1),
+          m_writer(&SendQueue::writerLoop, this) {}
+
+    ~SendQueue() {
+        close();
+        if (m_writer.joinable()) m_writer.join();
+    }
+
+    SendQueue(const SendQueue &) = delete;
+    SendQueue &operator=(const SendQueue &) = delete;
+
+    // Returns false if earlier buffers had to be dropped or the queue is closed
+    bool push(SharedBuffer buf) {
+        bool kept = true;
+        {
+            std::lock_guard<std::mutex> lk(m_mutex);
+            if (m_closed) return false;
+            if (m_count == m_ring.size()) {
+                dropAll();
+                kept = false;
+            }
+            m_ring[(m_head + m_count++) % m_ring.size()] = std::move(buf);
+        }
+        m_cv.notify_one();
+        return kept;
+    }
+
+    // Stops accepting buffers; whatever is queued is still written
+    void close() {
+        {
+            std::lock_guard<std::mutex> lk(m_mutex);
+            m_closed = true;
+        }
+        m_cv.notify_one();
+    }
+
+private:
+    void writerLoop() {
+        while (true) {
+            SharedBuffer buf;
+            {
+                std::unique_lock<std::mutex> lk(m_mutex);
+                m_cv.wait(lk, [this] { return m_closed || m_count > 0; });
+                if (m_count == 0) return;
+                buf = std::move(m_ring[m_head]);
+                m_head = (m_head + 1) % m_ring.size();
+                m_count--;
+            }
+            if (!m_conn->sendBuffer(buf)) {
+                std::lock_guard<std::mutex> lk(m_mutex);
+                m_closed = true;
+                dropAll();
+                return;
+            }
+        }
+    }
+
+    // Caller holds m_mutex
+    void dropAll() {
+        for (auto &b : m_ring) b.reset();
+        m_head = m_count = 0;
+    }
+
+    std::shared_ptr<TCPConnection> m_conn;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    // Fixed ring sized once, so queueing never allocates
+    std::vector<SharedBuffer> m_ring;
+    size_t m_head = 0, m_count = 0;
+    bool m_closed = false;
+
+    std::thread m_writer;   // last: starts after the members above exist
+};
+
 class TCPServer {
 public:
     TCPServer() : m_sock(-1), m_running(false) {}
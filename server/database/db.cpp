@@ -123,6 +123,7 @@ void Database::initIfEmpty() {
     if (!m_root.contains("versions"))   m_root["versions"]   = json::array();
     if (!m_root.contains("reviews"))    m_root["reviews"]    = json::array();
     if (!m_root.contains("rooms"))      m_root["rooms"]      = json::array();
+    if (!m_root.contains("matches"))    m_root["matches"]    = json::array();
 
     ensureCounters();
 }
@@ -140,6 +141,7 @@ void Database::ensureCounters() {
     if (!c.contains("version_id"))   c["version_id"]   = 1;
     if (!c.contains("review_id"))    c["review_id"]    = 1;
     if (!c.contains("room_id"))      c["room_id"]      = 1;
+    if (!c.contains("match_id"))     c["match_id"]     = 1;
 }
 
 int Database::nextId(const std::string &counter) {
@@ -371,6 +373,20 @@ bool Database::deactivateGame(int gameId, int developerId) {
     return true;
 }
 
+bool Database::removeUnpublishedGame(int gameId) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    auto &games = m_root["games"];
+    for (auto it = games.begin(); it != games.end(); ++it) {
+        if (it->value("id", -1) != gameId) continue;
+        if (!(*it)["latest_version_id"].is_null()) return false;
+        games.erase(it);
+        save();
+        return true;
+    }
+    return false;
+}
+
 bool Database::isGameOwnedBy(int gameId, int developerId) {
     std::lock_guard<std::mutex> guard(m_mutex);
 
@@ -510,7 +526,44 @@ bool Database::addReview(int gameId, int playerId, int score, const std::string
     return true;
 }
 
+int Database::addMatchResult(int gameId, int roomId, const std::vector<int> &players,
+                             int winnerId, int turns) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    int id = nextId("match_id");
+
+    json m = {
+        {"id", id},
+        {"game_id", gameId},
+        {"room_id", roomId},
+        {"players", players},
+        {"winner_id", winnerId},
+        {"turns", turns},
+        {"ended_at", (long long)std::time(nullptr)}
+    };
+
+    m_root["matches"].push_back(m);
+    save();
+    return id;
+}
+
+json Database::listMatchResults() {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_root["matches"];
+}
+
+std::string Database::getPlayerName(int playerId) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    for (const auto &p : m_root["players"]) {
+        if (p.value("id", -1) == playerId)
+            return p.value("username", std::string());
+    }
+    return "";
+}
+
 json Database::getGameReviews(int gameId) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+
     json out = json::array();
     for (auto &r : m_root["reviews"]) {
         if (r.value("game_id", -1) == gameId) {
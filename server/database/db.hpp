@@ -65,6 +65,9 @@ public:
     //Soft delete
     bool deactivateGame(int gameId, int developerId);
 
+    //Drops a game row that never got a version (its first upload failed)
+    bool removeUnpublishedGame(int gameId);
+
     //Ownership check
     bool isGameOwnedBy(int gameId, int developerId);
 
@@ -79,6 +82,14 @@ public:
     std::string getLatestVersionStoragePath(int gameId);
     bool addReview(int gameId, int playerId, int score, const std::string &comment);
     json getGameReviews(int gameId);
+
+    //Match history; winnerId -1 = draw, 0 = won by no account (an AI).
+    //Returns match id
+    int addMatchResult(int gameId, int roomId, const std::vector<int> &players,
+                       int winnerId, int turns);
+    json listMatchResults();   // oldest first
+
+    std::string getPlayerName(int playerId);
     void init();
 
 private:
@@ -7,7 +7,9 @@
 using nlohmann::json;
 
 DeveloperServer::DeveloperServer(int port)
-    : m_port(port)
+    : m_port(port),
+      m_dispatcher(std::max(2u, std::thread::hardware_concurrency()), 2),
+      m_ingest(2)
 {
 }
 
@@ -26,7 +28,7 @@ bool DeveloperServer::start() {
 
     addHandler(PacketType::DEV_UPLOAD_GAME,
         [this](TCPConnection &conn, const json &d) {
-            handleUploadGame(conn, d);
+            handleUploadGame(conn, d, m_ingest);
         });
 
     addHandler(PacketType::DEV_LIST_MY_GAMES,
@@ -36,7 +38,7 @@ bool DeveloperServer::start() {
 
     addHandler(PacketType::DEV_UPDATE_GAME,
         [this](TCPConnection &conn, const json &d) {
-            handleUpdateGame(conn, d);
+            handleUpdateGame(conn, d, m_ingest);
         });
 
     addHandler(PacketType::DEV_REMOVE_GAME,
@@ -69,9 +71,10 @@ bool DeveloperServer::start() {
 
 void DeveloperServer::addHandler(
     PacketType type,
-    std::function<void(TCPConnection&, const json&)> handler)
+    std::function<void(TCPConnection&, const json&)> handler,
+    ExecClass cls)
 {
-    m_handlers[type] = std::move(handler);
+    m_dispatcher.add(type, cls, std::move(handler));
 }
 
 void DeveloperServer::onClient(std::shared_ptr<TCPConnection> conn) {
@@ -84,14 +87,8 @@ void DeveloperServer::onClient(std::shared_ptr<TCPConnection> conn) {
                 << " json=" << packet.data.dump()
                 << "\n";
 
-        auto it = m_handlers.find(packet.type);
-        if (it == m_handlers.end()) {
+        if (!m_dispatcher.dispatch(conn, std::move(packet))) {
             std::cout << "[DEBUG][SERVER] No handler for this packet type!\n";
-        }
-
-        if (it != m_handlers.end()) {
-            it->second(*conn, packet.data);
-        } else {
             Packet res;
             res.type = PacketType::ERROR_RESPONSE;
             res.data["msg"] = "Unknown developer command.";
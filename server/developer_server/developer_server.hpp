@@ -3,7 +3,6 @@
 
 #include <vector>
 #include <mutex>
-#include <map>
 #include <memory>
 #include <functional>
 #include <algorithm>
@@ -12,6 +11,8 @@
 #include "../shared/tcp.hpp"
 #include "../shared/packet.hpp"
 #include "../shared/json.hpp"
+#include "../shared/dispatcher.hpp"
+#include "ingest_pipeline.hpp"
 using nlohmann::json;
 
 class DeveloperServer {
@@ -22,7 +23,8 @@ public:
 
     void addHandler(
         PacketType type,
-        std::function<void(TCPConnection&, const nlohmann::json&)> handler
+        std::function<void(TCPConnection&, const nlohmann::json&)> handler,
+        ExecClass cls = ExecClass::Inline
     );
 
 private:
@@ -34,8 +36,8 @@ private:
     std::vector<std::shared_ptr<TCPConnection>> m_clients;
     std::mutex m_clientsMutex;
 
-    std::map<PacketType,
-        std::function<void(TCPConnection&, const nlohmann::json&)>> m_handlers;
+    PacketDispatcher m_dispatcher;
+    IngestPipeline   m_ingest;
 
     void onClient(std::shared_ptr<TCPConnection> conn);
     void sendKeepAlive();
@@ -46,6 +48,6 @@ private:
 void handleDeveloperLogin(TCPConnection&, const json&);
 void handle_register(TCPConnection&, const json&);
 void handleListMyGames(TCPConnection&, const json&);
-void handleUploadGame(TCPConnection&, const json&);
-void handleUpdateGame(TCPConnection&, const json&);
+void handleUploadGame(TCPConnection&, const json&, IngestPipeline&);
+void handleUpdateGame(TCPConnection&, const json&, IngestPipeline&);
 void handleRemoveGame(TCPConnection&, const json&);
\ No newline at end of file
@@ -1,25 +1,16 @@
 #include "../developer_server.hpp"
 #include "../../database/db.hpp"
-#include "../base64.hpp"
+#include "../ingest_pipeline.hpp"
 
-#include <filesystem>
-#include <fstream>
 #include <iostream>
-#include <sys/stat.h>
 
-namespace fs = std::filesystem;
-
-static bool writeBinary(const std::string &p, const std::vector<uint8_t>&buf) {
-    std::ofstream f(p, std::ios::binary);
-    if (!f) return false;
-    f.write((char*)buf.data(), buf.size());
-    return true;
+// Version strings become folder names
+static bool validPathPart(const std::string &s) {
+    return !s.empty() && s != "." && s != ".." &&
+           s.find('/') == std::string::npos && s.find('\\') == std::string::npos;
 }
 
-void handleUploadGame(TCPConnection &conn, const json &d) {
-
-    std::cout << "[DEBUG][SERVER] handleUploadGame incoming: "
-              << d.dump() << "\n";
+void handleUploadGame(TCPConnection &conn, const json &d, IngestPipeline &ingest) {
 
     Packet r;
     r.type = PacketType::SERVER_RESPONSE;
@@ -41,6 +32,13 @@ void handleUploadGame(TCPConnection &conn, const json &d) {
     std::string fn = d.value("filename", "");
     std::string b64= d.value("filedata_base64", "");
 
+    if (!validPathPart(ver) || !validPathPart(fn)) {
+        r.data["ok"] = false;
+        r.data["msg"] = "Invalid version_str or filename";
+        conn.sendPacket(r);
+        return;
+    }
+
     bool isUpdate = d.contains("game_id");
 
     int gameId = -1;
@@ -110,64 +108,27 @@ void handleUploadGame(TCPConnection &conn, const json &d) {
         std::cout << "[DEBUG][SERVER] Created new game_id=" << gameId << "\n";
     }
 
-    std::vector<uint8_t> rawZip = decodeBase64(b64);
-    if (rawZip.empty()) {
-        r.data["ok"] = false;
-        r.data["msg"] = "Empty or invalid base64 ZIP";
-        conn.sendPacket(r);
-        return;
-    }
-
-    std::string verFolder =
-        "uploaded_games/game_" + std::to_string(gameId) + "/" + ver + "/";
-
-    fs::create_directories(verFolder);
-
-    std::string zipPath = verFolder + fn;
-
-    if (!writeBinary(zipPath, rawZip)) {
-        r.data["ok"] = false;
-        r.data["msg"] = "Failed to write ZIP file";
-        conn.sendPacket(r);
-        return;
-    }
-
-    // Unzip
-    std::cout<<"unzipping\n";
-    std::string cmd = "unzip -o \"" + zipPath + "\" -d \"" + verFolder + "\"";
-    system(cmd.c_str());
-    std::cout<<"unzipping complete\n";
-    // After unzip, auto-chmod everything inside /server and /client_* folders
-    {
-    std::vector<std::string> dirs = {
-        verFolder + "server",
-        verFolder + "client_cli",
-        verFolder + "client_gui"
-    };
-
-    for (auto &dir : dirs) {
-        if (!fs::exists(dir)) continue;
-
-        for (auto &entry : fs::directory_iterator(dir)) {
-            if (entry.is_regular_file()) {
-                std::string p = entry.path().string();
-                ::chmod(p.c_str(), 0755);
-                std::cout << "[DEBUG] chmod +x " << p << "\n";
-            }
-        }
-    }
-}
-
-    int verId = Database::instance().addGameVersion(gameId, ver, verFolder);
-
-    r.data["ok"]          = true;
-    r.data["game_id"]     = gameId;
-    r.data["version_id"]  = verId;
-    r.data["version_str"] = ver;
-
+    // Heavy lifting happens on the ingest pool; reply with the job id now
+    IngestJob job;
+    job.id       = ingest.newJobId();
+    job.gameId   = gameId;
+    job.version  = ver;
+    job.filename = fn;
+    job.sha256   = d.value("sha256", "");
+    job.base64   = std::move(b64);
+    job.newGame  = !isUpdate;
+    job.conn     = conn.shared_from_this();
+    job.reqId    = ReplyScope::reqIdFor(&conn);
+
+    r.data["kind"]    = "DEV_UPLOAD_ACCEPTED";
+    r.data["ok"]      = true;
+    r.data["job_id"]  = job.id;
+    r.data["game_id"] = gameId;
     conn.sendPacket(r);
+
+    ingest.submit(std::move(job));
 }
 
-void handleUpdateGame(TCPConnection &conn, const nlohmann::json &d) {
-    handleUploadGame(conn, d);
+void handleUpdateGame(TCPConnection &conn, const nlohmann::json &d, IngestPipeline &ingest) {
+    handleUploadGame(conn, d, ingest);
 }
\ No newline at end of file
@@ -0,0 +1,217 @@
+#include "ingest_pipeline.hpp"
+#include "../database/db.hpp"
+#include "../shared/json.hpp"
+#include "../shared/packet.hpp"
+#include "base64.hpp"
+#include "miniunzip.hpp"
+#include "sha256.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace fs = std::filesystem;
+using nlohmann::json;
+
+// Cached base64 of the archive, served as-is by the lobby's download handler
+static const char *kDownloadCacheName = "game.zip.b64";
+static const char *kManifestName      = "manifest.json";
+
+// Written next to the extracted files, so an archive may not bring its own
+static bool isReservedName(const fs::path &staging, const char *name) {
+    std::error_code ec;
+    return fs::symlink_status(staging / name, ec).type() != fs::file_type::not_found;
+}
+
+static bool writeFile(const fs::path &p, const char *data, size_t len) {
+    std::ofstream f(p, std::ios::binary);
+    if (!f) return false;
+    f.write(data, (std::streamsize)len);
+    return (bool)f;
+}
+
+IngestPipeline::IngestPipeline(std::size_t workers)
+    : m_pool(workers)
+{
+}
+
+void IngestPipeline::submit(IngestJob job) {
+    auto shared = std::make_shared<IngestJob>(std::move(job));
+    m_pool.submit([this, shared]() { run(*shared); });
+}
+
+void IngestPipeline::run(IngestJob &job) {
+    auto send = [&](Packet &p) {
+        if (auto c = job.conn.lock()) {
+            ReplyScope scope(c.get(), job.reqId);
+            c->sendPacket(p);
+        }
+    };
+
+    auto progress = [&](const char *stage) {
+        Packet p;
+        p.type = PacketType::SERVER_RESPONSE;
+        p.data["kind"]   = "DEV_UPLOAD_PROGRESS";
+        p.data["ok"]     = true;
+        p.data["job_id"] = job.id;
+        p.data["stage"]  = stage;
+        send(p);
+    };
+
+    std::string gameFolder = "uploaded_games/game_" + std::to_string(job.gameId) + "/";
+    std::string verFolder  = gameFolder + job.version + "/";
+    fs::path staging = gameFolder + ".ingest_" + std::to_string(job.id);
+    // The archive sits beside the staging folder, not in it: an entry that
+    // extracted over it would truncate the file being read
+    fs::path zipPath = staging;
+    zipPath += ".zip";
+
+    auto fail = [&](const std::string &msg) {
+        std::cerr << "[Ingest] job " << job.id << " failed: " << msg << "\n";
+        std::error_code ec;
+        fs::remove_all(staging, ec);
+        fs::remove(zipPath, ec);
+        if (job.newGame && Database::instance().removeUnpublishedGame(job.gameId))
+            fs::remove(gameFolder, ec);   // only if empty
+
+        Packet r;
+        r.type = PacketType::SERVER_RESPONSE;
+        r.data["kind"]   = "DEV_UPLOAD_GAME";
+        r.data["ok"]     = false;
+        r.data["job_id"] = job.id;
+        r.data["msg"]    = msg;
+        send(r);
+    };
+
+    // Decode + verify
+    progress("decode");
+    std::vector<uint8_t> rawZip = decodeBase64(job.base64);
+    job.base64.clear();
+    job.base64.shrink_to_fit();
+    if (rawZip.empty()) return fail("Empty or invalid base64 ZIP");
+
+    progress("verify");
+    std::string digest = sha256Hex(rawZip);
+    if (!job.sha256.empty() && job.sha256 != digest)
+        return fail("SHA-256 mismatch (upload corrupted)");
+
+    // Stage + extract
+    progress("extract");
+    std::error_code ec;
+    fs::remove_all(staging, ec);
+    fs::create_directories(staging, ec);
+    if (ec) return fail("Cannot create staging folder");
+
+    if (!writeFile(zipPath, reinterpret_cast<const char*>(rawZip.data()), rawZip.size()))
+        return fail("Failed to write ZIP file");
+    if (!unzipToDir(zipPath.string(), staging.string()))
+        return fail("Failed to extract ZIP file");
+    fs::remove(zipPath, ec);
+
+    for (const char *name : {kManifestName, kDownloadCacheName}) {
+        if (isReservedName(staging, name))
+            return fail(std::string("ZIP may not contain ") + name);
+    }
+
+    // Per-file manifest, sorted by path so it diffs cleanly between versions
+    progress("manifest");
+    json files = json::array();
+    std::vector<fs::path> paths;
+    for (auto it = fs::recursive_directory_iterator(staging, ec);
+         !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if (it->is_regular_file())
+            paths.push_back(it->path());
+    }
+    if (ec) return fail("Cannot scan extracted files");
+    std::sort(paths.begin(), paths.end());
+
+    for (auto &p : paths) {
+        std::string hash = sha256File(p.string());
+        if (hash.empty()) return fail("Cannot read " + p.filename().string());
+        files.push_back({
+            {"path",   fs::relative(p, staging).generic_string()},
+            {"size",   (uint64_t)fs::file_size(p)},
+            {"mode",   (int)(fs::status(p).permissions() & fs::perms::mask)},
+            {"sha256", hash}
+        });
+    }
+
+    json manifest = {
+        {"game_id", job.gameId},
+        {"version", job.version},
+        {"archive", {
+            {"file",   job.filename},
+            {"size",   (uint64_t)rawZip.size()},
+            {"sha256", digest}
+        }},
+        {"files", files}
+    };
+    std::string manifestText = manifest.dump(2);
+    if (!writeFile(staging / kManifestName, manifestText.data(), manifestText.size()))
+        return fail("Failed to write manifest");
+
+    // Download cache: the lobby sends this verbatim instead of re-encoding
+    progress("cache");
+    std::string encoded = encodeBase64(rawZip);
+    rawZip.clear();
+    rawZip.shrink_to_fit();
+    if (!writeFile(staging / kDownloadCacheName, encoded.data(), encoded.size()))
+        return fail("Failed to write download cache");
+
+    // Publish
+    progress("publish");
+    std::string err;
+    if (!publish(staging.string(), verFolder, err))
+        return fail(err);
+
+    int verId = Database::instance().addGameVersion(job.gameId, job.version, verFolder);
+
+    Packet r;
+    r.type = PacketType::SERVER_RESPONSE;
+    r.data["kind"]        = "DEV_UPLOAD_GAME";
+    r.data["ok"]          = true;
+    r.data["job_id"]      = job.id;
+    r.data["game_id"]     = job.gameId;
+    r.data["version_id"]  = verId;
+    r.data["version_str"] = job.version;
+    r.data["sha256"]      = digest;
+    r.data["files"]       = paths.size();
+    send(r);
+
+    std::cout << "[Ingest] job " << job.id << " published game_id=" << job.gameId
+              << " version=" << job.version << " (" << paths.size() << " files)\n";
+}
+
+// Swaps the staging folder into place. Re-uploading an existing version
+// replaces it; a half-extracted folder is never visible.
+bool IngestPipeline::publish(const std::string &stagingDir,
+                             const std::string &verFolder,
+                             std::string &err) {
+    std::lock_guard<std::mutex> lk(m_publishMutex);
+
+    fs::path target = fs::path(verFolder).parent_path();   // strip trailing '/'
+    fs::path retired = target;
+    retired += ".old";
+
+    std::error_code ec;
+    fs::remove_all(retired, ec);
+    if (fs::exists(target)) {
+        fs::rename(target, retired, ec);
+        if (ec) {
+            err = "Cannot replace existing version: " + ec.message();
+            return false;
+        }
+    }
+
+    fs::rename(stagingDir, target, ec);
+    if (ec) {
+        err = "Cannot publish version: " + ec.message();
+        std::error_code ignore;
+        fs::rename(retired, target, ignore);   // put the old one back
+        return false;
+    }
+
+    fs::remove_all(retired, ec);
+    return true;
+}
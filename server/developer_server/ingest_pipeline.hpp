@@ -0,0 +1,53 @@
+#ifndef INGEST_PIPELINE_HPP
+#define INGEST_PIPELINE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "../shared/tcp.hpp"
+#include "../shared/thread_pool.hpp"
+
+// One accepted upload, already validated against the DB.
+struct IngestJob {
+    uint64_t    id = 0;
+    int         gameId = -1;
+    std::string version;
+    std::string filename;
+    std::string sha256;        // hex digest from the client, may be empty
+    std::string base64;        // archive as received
+    bool        newGame = false;   // the game row was created for this upload
+
+    std::weak_ptr<TCPConnection> conn;   // progress + result go here
+    uint32_t    reqId = 0;               // echoed on every event
+};
+
+// Turns uploads into published versions off the connection thread:
+//   decode -> verify -> stage -> extract -> manifest -> cache -> publish
+// Each job works in its own staging folder next to the version folders and
+// only becomes visible (folder rename + DB row) once every stage passed.
+// A game created for the upload is removed again if its first one fails.
+// The developer gets DEV_UPLOAD_PROGRESS per stage and a final
+// DEV_UPLOAD_GAME; if they disconnect the job still completes.
+class IngestPipeline {
+public:
+    explicit IngestPipeline(std::size_t workers);
+
+    // Ids are handed out first so the caller can acknowledge the upload
+    // before any progress event for it can be sent
+    uint64_t newJobId() { return m_nextId++; }
+    void submit(IngestJob job);
+
+private:
+    void run(IngestJob &job);
+    bool publish(const std::string &stagingDir, const std::string &verFolder,
+                 std::string &err);
+
+    std::atomic<uint64_t> m_nextId{1};
+    std::mutex m_publishMutex;   // version folder swaps
+    ThreadPool m_pool;
+};
+
+#endif
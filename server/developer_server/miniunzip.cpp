@@ -0,0 +1,348 @@
+#include "miniunzip.hpp"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Sum of the entries' declared sizes; each entry is held to its own, so
+// this bounds what one archive can write
+constexpr uint64_t kMaxTotalBytes = 1ull << 30;
+
+struct ZipEntry {
+    std::string name;
+    uint16_t    method    = 0;
+    uint32_t    crc       = 0;
+    uint32_t    compSize  = 0;
+    uint32_t    size      = 0;
+    uint32_t    localOff  = 0;
+    int         mode      = -1;   // unix permission bits, -1 if absent
+    bool        isDir     = false;
+};
+
+// Read-only view of the archive; entries are inflated from it directly
+struct MappedFile {
+    const uint8_t *data = nullptr;
+    size_t         size = 0;
+    dev_t          dev  = 0;     // identity of the archive on disk
+    ino_t          ino  = 0;
+
+    bool open(const std::string &path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st{};
+        if (::fstat(fd, &st) < 0 || st.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void *p = ::mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) return false;
+        data = static_cast<const uint8_t*>(p);
+        size = (size_t)st.st_size;
+        dev  = st.st_dev;
+        ino  = st.st_ino;
+        return true;
+    }
+
+    ~MappedFile() {
+        if (data) ::munmap(const_cast<uint8_t*>(data), size);
+    }
+};
+
+uint16_t rd16(const uint8_t *p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+uint32_t rd32(const uint8_t *p) { return (uint32_t)rd16(p) | ((uint32_t)rd16(p + 2) << 16); }
+
+// Relative, '/'-separated, no "..", no drive letters
+bool safeEntryName(const std::string &name) {
+    if (name.empty() || name[0] == '/' || name[0] == '\\') return false;
+    if (name.find('\\') != std::string::npos) return false;
+    if (name.find(':') != std::string::npos) return false;
+
+    size_t start = 0;
+    while (start <= name.size()) {
+        size_t end = name.find('/', start);
+        if (end == std::string::npos) end = name.size();
+        if (name.compare(start, end - start, "..") == 0 && end - start == 2)
+            return false;
+        start = end + 1;
+    }
+    return true;
+}
+
+bool readCentralDirectory(const MappedFile &zip, std::vector<ZipEntry> &out) {
+    const uint8_t *base = zip.data;
+    size_t n = zip.size;
+    if (n < 22) return false;
+
+    // End of central directory record, possibly followed by a comment
+    size_t lowest = (n > 22 + 0xFFFF) ? n - 22 - 0xFFFF : 0;
+    size_t eocd = SIZE_MAX;
+    for (size_t i = n - 22 + 1; i-- > lowest;) {
+        if (rd32(base + i) == 0x06054b50) {
+            eocd = i;
+            break;
+        }
+    }
+    if (eocd == SIZE_MAX) return false;
+
+    uint16_t count = rd16(base + eocd + 10);
+    uint32_t cdOff = rd32(base + eocd + 16);
+    if (count == 0xFFFF || cdOff == 0xFFFFFFFF) {
+        std::cerr << "ZIP64 archives are not supported\n";
+        return false;
+    }
+
+    size_t pos = cdOff;
+    out.reserve(count);
+    for (uint16_t i = 0; i < count; i++) {
+        if (pos + 46 > n || rd32(base + pos) != 0x02014b50) return false;
+        const uint8_t *h = base + pos;
+
+        uint16_t madeBy  = rd16(h + 4);
+        uint16_t flags   = rd16(h + 8);
+        uint16_t nameLen = rd16(h + 28);
+        uint16_t extLen  = rd16(h + 30);
+        uint16_t cmtLen  = rd16(h + 32);
+        uint32_t extAttr = rd32(h + 38);
+        if (pos + 46 + nameLen > n) return false;
+
+        ZipEntry e;
+        e.name     = std::string(reinterpret_cast<const char*>(h + 46), nameLen);
+        e.method   = rd16(h + 10);
+        e.crc      = rd32(h + 16);
+        e.compSize = rd32(h + 20);
+        e.size     = rd32(h + 24);
+        e.localOff = rd32(h + 42);
+        e.isDir    = !e.name.empty() && e.name.back() == '/';
+
+        if (flags & 0x1) {
+            std::cerr << "Encrypted entry not supported: " << e.name << "\n";
+            return false;
+        }
+
+        // Made on unix: high 16 bits of the external attributes are st_mode
+        if ((madeBy >> 8) == 3 && (extAttr >> 16) != 0) {
+            uint32_t stMode = extAttr >> 16;
+            if (S_ISLNK(stMode)) {
+                std::cerr << "Skipping symlink entry: " << e.name << "\n";
+                pos += 46 + nameLen + extLen + cmtLen;
+                continue;
+            }
+            e.mode = (int)(stMode & 0777);
+        }
+
+        out.push_back(std::move(e));
+        pos += 46 + nameLen + extLen + cmtLen;
+    }
+    return true;
+}
+
+bool looksExecutable(const uint8_t *head, size_t len) {
+    if (len >= 4 && std::memcmp(head, "\x7f" "ELF", 4) == 0) return true;
+    if (len >= 2 && head[0] == '#' && head[1] == '!') return true;
+    return false;
+}
+
+bool writeAll(int fd, const uint8_t *p, size_t len) {
+    while (len > 0) {
+        ssize_t w = ::write(fd, p, len);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p   += w;
+        len -= (size_t)w;
+    }
+    return true;
+}
+
+bool extractEntry(const MappedFile &zip, const ZipEntry &e, const std::string &outPath) {
+    size_t lh = e.localOff;
+    if (lh + 30 > zip.size || rd32(zip.data + lh) != 0x04034b50) return false;
+    size_t dataOff = lh + 30 + rd16(zip.data + lh + 26) + rd16(zip.data + lh + 28);
+    if (dataOff + e.compSize > zip.size) return false;
+    const uint8_t *src = zip.data + dataOff;
+
+    // Truncated only once it is known not to be the archive itself (the
+    // same name, or a link to it): that would pull the mapping out from
+    // under the reads
+    int fd = ::open(outPath.c_str(), O_WRONLY | O_CREAT, 0644);
+    if (fd < 0) return false;
+    struct stat st{};
+    if (::fstat(fd, &st) < 0 || (st.st_dev == zip.dev && st.st_ino == zip.ino)) {
+        std::cerr << "Entry would overwrite the archive: " << e.name << "\n";
+        ::close(fd);
+        return false;
+    }
+    if (::ftruncate(fd, 0) < 0) {
+        ::close(fd);
+        return false;
+    }
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    bool ok = true;
+    bool exec = false;
+
+    if (e.method == 0) {
+        exec = looksExecutable(src, e.compSize);
+        crc = crc32(crc, src, e.compSize);
+        ok = (e.compSize == e.size) && writeAll(fd, src, e.compSize);
+    } else if (e.method == 8) {
+        z_stream zs{};
+        if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+            ::close(fd);
+            return false;
+        }
+        zs.next_in  = const_cast<Bytef*>(src);
+        zs.avail_in = e.compSize;
+
+        uint8_t buf[64 * 1024];
+        bool first = true;
+        int zr = Z_OK;
+        while (ok && zr != Z_STREAM_END) {
+            zs.next_out  = buf;
+            zs.avail_out = sizeof(buf);
+            zr = inflate(&zs, Z_NO_FLUSH);
+            if (zr != Z_OK && zr != Z_STREAM_END) {
+                ok = false;
+                break;
+            }
+            size_t have = sizeof(buf) - zs.avail_out;
+            if (zs.total_out > e.size) {
+                std::cerr << "Entry inflates past its declared size: " << e.name << "\n";
+                ok = false;
+                break;
+            }
+            if (first && have > 0) {
+                exec  = looksExecutable(buf, have);
+                first = false;
+            }
+            crc = crc32(crc, buf, (uInt)have);
+            ok = writeAll(fd, buf, have);
+            if (zr == Z_OK && have == 0 && zs.avail_in == 0) ok = false;   // truncated
+        }
+        ok = ok && zs.total_out == e.size;
+        inflateEnd(&zs);
+    } else {
+        std::cerr << "Unsupported compression method " << e.method
+                  << " for " << e.name << "\n";
+        ok = false;
+    }
+
+    if (ok && crc != e.crc) {
+        std::cerr << "CRC mismatch for " << e.name << "\n";
+        ok = false;
+    }
+
+    int mode = (e.mode >= 0) ? e.mode : (exec ? 0755 : 0644);
+    ::fchmod(fd, (mode_t)mode);
+    ::close(fd);
+    return ok;
+}
+
+} // namespace
+
+bool unzipToDir(const std::string &zipPath, const std::string &outDir, unsigned threads) {
+    namespace fs = std::filesystem;
+
+    MappedFile zip;
+    if (!zip.open(zipPath)) {
+        std::cerr << "Failed to open ZIP: " << zipPath << "\n";
+        return false;
+    }
+
+    std::vector<ZipEntry> entries;
+    if (!readCentralDirectory(zip, entries)) {
+        std::cerr << "Malformed ZIP: " << zipPath << "\n";
+        return false;
+    }
+
+    // Two entries for one path would race in the workers; "x" and "x/"
+    // are the same path
+    std::set<std::string> names;
+    uint64_t total = 0;
+    for (auto &e : entries) {
+        if (!safeEntryName(e.name)) {
+            std::cerr << "Rejecting unsafe ZIP entry: " << e.name << "\n";
+            return false;
+        }
+        std::string key = e.isDir ? e.name.substr(0, e.name.size() - 1) : e.name;
+        if (!names.insert(key).second) {
+            std::cerr << "Rejecting duplicate ZIP entry: " << e.name << "\n";
+            return false;
+        }
+        total += e.size;
+    }
+    if (total > kMaxTotalBytes) {
+        std::cerr << "ZIP expands to " << total << " bytes, over the "
+                  << kMaxTotalBytes << " byte limit: " << zipPath << "\n";
+        return false;
+    }
+
+    // Directories are created up front so workers only ever write files
+    std::error_code ec;
+    fs::create_directories(outDir, ec);
+    std::set<std::string> dirs;
+    std::vector<const ZipEntry*> files;
+    for (auto &e : entries) {
+        if (e.isDir) {
+            dirs.insert(outDir + "/" + e.name);
+        } else {
+            dirs.insert(fs::path(outDir + "/" + e.name).parent_path().string());
+            files.push_back(&e);
+        }
+    }
+    for (auto &d : dirs) {
+        fs::create_directories(d, ec);
+        if (ec) {
+            std::cerr << "Cannot create " << d << ": " << ec.message() << "\n";
+            return false;
+        }
+    }
+
+    // Largest first keeps one big binary from finishing last on its own
+    std::sort(files.begin(), files.end(),
+              [](const ZipEntry *a, const ZipEntry *b) { return a->size > b->size; });
+
+    if (threads == 0)
+        threads = std::max(1u, std::min(8u, std::thread::hardware_concurrency()));
+    threads = std::min<unsigned>(threads, (unsigned)std::max<size_t>(1, files.size()));
+
+    std::atomic<size_t> next{0};
+    std::atomic<bool> failed{false};
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next.fetch_add(1)) < files.size()) {
+            const ZipEntry &e = *files[i];
+            if (!extractEntry(zip, e, outDir + "/" + e.name)) {
+                std::cerr << "Failed to extract " << e.name << "\n";
+                failed = true;
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; t++)
+        pool.emplace_back(worker);
+    worker();
+    for (auto &t : pool) t.join();
+
+    return !failed;
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <string>
+
+// Extracts a .zip file (zipPath) into outDir
+// Entries are inflated straight to disk, spread over `threads` workers
+// (0 = pick from core count). Unix mode bits stored in the archive are
+// applied; archives without them get 0755 for ELF binaries and #! scripts.
+// Entries whose path would land outside outDir are rejected, as are
+// archives naming a path twice or expanding past 1 GiB in all, and an
+// entry inflating past the size it declares.
+// Returns true on success
+bool unzipToDir(const std::string &zipPath, const std::string &outDir,
+                unsigned threads = 0);
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Incremental SHA-256 (FIPS 180-4)
+class Sha256 {
+public:
+    Sha256();
+    void update(const uint8_t *data, size_t len);
+    std::string hexDigest();   // finalizes; call once
+
+private:
+    void block(const uint8_t *p);
+
+    uint32_t m_h[8];
+    uint8_t  m_buf[64];
+    size_t   m_bufLen = 0;
+    uint64_t m_total  = 0;
+};
+
+std::string sha256Hex(const std::vector<uint8_t> &data);
+// Streams the file; returns "" if it cannot be read
+std::string sha256File(const std::string &path);
@@ -35,12 +35,14 @@ void handleCreateRoom(TCPConnection &conn, const nlohmann::json &d) {
     }
 
     int rid = server->createRoom(gid, pid, maxPlayers);
-    Room *room = server->getRoom(rid);
+    Room room;
+    if (!server->getRoom(rid, room))
+        room.players = {pid};   // the host dropped already
 
     r.data["ok"]      = true;
     r.data["room_id"] = rid;
     r.data["game_id"] = gid;
-    r.data["players"] = room->players;
+    r.data["players"] = room.players;
 
     conn.sendPacket(r);
 }
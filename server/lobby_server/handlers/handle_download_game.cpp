@@ -29,27 +29,35 @@ void handleDownloadGame(TCPConnection &conn, const nlohmann::json &d) {
         return;
     }
 
-    std::string zipFile = folder + "game.zip";
-
-    std::ifstream fin(zipFile, std::ios::binary);
-    if (!fin) {
-        r.data["ok"] = false;
-        r.data["msg"] = "Missing game.zip on server.";
-        conn.sendPacket(r);
-        return;
+    // Versions ingested by the dev server carry a pre-encoded copy
+    std::string b64;
+    std::ifstream cached(folder + "game.zip.b64", std::ios::binary);
+    if (cached) {
+        b64.assign(std::istreambuf_iterator<char>(cached),
+                   std::istreambuf_iterator<char>());
+    } else {
+        std::string zipFile = folder + "game.zip";
+
+        std::ifstream fin(zipFile, std::ios::binary);
+        if (!fin) {
+            r.data["ok"] = false;
+            r.data["msg"] = "Missing game.zip on server.";
+            conn.sendPacket(r);
+            return;
+        }
+
+        std::vector<uint8_t> raw(
+            (std::istreambuf_iterator<char>(fin)),
+            std::istreambuf_iterator<char>()
+        );
+
+        b64 = encodeBase64(raw);
     }
 
-    std::vector<uint8_t> raw(
-        (std::istreambuf_iterator<char>(fin)),
-        std::istreambuf_iterator<char>()
-    );
-
-    std::string b64 = encodeBase64(raw);
-
     r.data["ok"] = true;
     r.data["version"] = ver;
     r.data["filename"] = "game.zip";
-    r.data["filedata_base64"] = b64;
+    r.data["filedata_base64"] = std::move(b64);
 
     conn.sendPacket(r);
 }
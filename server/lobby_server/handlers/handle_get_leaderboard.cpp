@@ -0,0 +1,64 @@
+#include "../lobby_server.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using json = nlohmann::json;
+
+static json entryJson(const Ratings::Entry &e) {
+    return {
+        {"rank", e.rank},
+        {"player_id", e.playerId},
+        {"username", e.name},
+        {"rating", (int)std::lround(e.rating)},
+        {"games", e.games},
+        {"wins", e.wins}
+    };
+}
+
+// {game_id, limit?, offset?} for a page of the top; add player_id (and
+// radius?) for that player's rank and the players around them
+void handleGetLeaderboard(TCPConnection &conn, const json &d) {
+    Packet r;
+    r.type = PacketType::SERVER_RESPONSE;
+    r.data["kind"] = "LEADERBOARD";
+
+    if (!d.contains("game_id")) {
+        r.data["ok"]  = false;
+        r.data["msg"] = "Missing game_id.";
+        conn.sendPacket(r);
+        return;
+    }
+
+    int gameId = d["game_id"];
+    int limit  = std::clamp(d.value("limit", 10), 0, 100);
+    int offset = std::max(0, d.value("offset", 0));
+
+    auto *server = reinterpret_cast<LobbyServer*>(conn.owner);
+    Ratings &ratings = server->ratings();
+
+    json top = json::array();
+    for (auto &e : ratings.top(gameId, offset, limit))
+        top.push_back(entryJson(e));
+
+    r.data["ok"]      = true;
+    r.data["game_id"] = gameId;
+    r.data["players"] = ratings.size(gameId);
+    r.data["top"]     = top;
+
+    if (d.contains("player_id")) {
+        int playerId = d["player_id"];
+        int radius   = std::clamp(d.value("radius", 5), 0, 50);
+
+        Ratings::Entry me;
+        if (ratings.find(gameId, playerId, me))
+            r.data["me"] = entryJson(me);
+
+        json around = json::array();
+        for (auto &e : ratings.around(gameId, playerId, radius))
+            around.push_back(entryJson(e));
+        r.data["around"] = around;
+    }
+
+    conn.sendPacket(r);
+}
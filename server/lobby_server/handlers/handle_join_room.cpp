@@ -33,38 +33,21 @@ void handleJoinRoom(TCPConnection &conn, const json &d) {
     int pid = d["player_id"].get<int>();
 
     auto *server = reinterpret_cast<LobbyServer*>(conn.owner);
-    Room *room = server->getRoom(rid);
+    Room room;
+    std::string err;
 
-    if (!room) {
+    // Checks the size and prevents a duplicate join under the rooms lock
+    if (!server->joinRoom(rid, pid, room, err)) {
         r.data["ok"] = false;
-        r.data["msg"] = "Room not found.";
+        r.data["msg"] = err;
         conn.sendPacket(r);
         return;
     }
 
-    if ((int)room->players.size() >= room->maxPlayers) {
-        r.data["ok"] = false;
-        r.data["msg"] = "Room full.";
-        conn.sendPacket(r);
-        return;
-    }
-
-    // Prevent duplicate join
-    bool alreadyIn = false;
-    for (int p : room->players) {
-        if (p == pid) {
-            alreadyIn = true;
-            break;
-        }
-    }
-    if (!alreadyIn) {
-        room->players.push_back(pid);
-    }
-
     // Reply only to the joining player
     r.data["ok"]      = true;
     r.data["room_id"] = rid;
-    r.data["game_id"] = room->gameId;
-    r.data["players"] = room->players;
+    r.data["game_id"] = room.gameId;
+    r.data["players"] = room.players;
     conn.sendPacket(r);
 }
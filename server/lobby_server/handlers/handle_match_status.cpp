@@ -0,0 +1,10 @@
+#include "../lobby_server.hpp"
+
+using json = nlohmann::json;
+
+// Reports from a game server we launched (see launchGameServer). Nothing
+// is sent back; the server does not read its lobby connection.
+void handleMatchStatus(TCPConnection &conn, const json &d) {
+    auto *server = reinterpret_cast<LobbyServer*>(conn.owner);
+    server->onMatchStatus(d);
+}
@@ -24,17 +24,21 @@ void handlePlayerLogin(TCPConnection &conn, const nlohmann::json &d) {
         r.data["ok"]  = false;
         r.data["msg"] = "Invalid credentials.";
     }
-    else if (server->isPlayerOnline(pid)) {
+    else if (!server->registerPlayer(pid, conn.fd())) {
+        // Checked and registered in one step, so two racing logins cannot
+        // both get in
         r.data["ok"]  = false;
         r.data["msg"] = "This account is already logged in from another client.";
     }
     else {
-        // First login for this player → register the mapping
-        int fd = conn.fd();
-        server->registerPlayer(pid, fd);
-
         r.data["ok"]       = true;
         r.data["player_id"] = pid;
+
+        // Dropped out of a match that is still running: tell the client
+        // where to resume it
+        json resume;
+        if (server->playerReturned(pid, resume))
+            r.data["resume"] = resume;
     }
 
     conn.sendPacket(r);
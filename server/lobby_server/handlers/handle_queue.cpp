@@ -0,0 +1,77 @@
+#include "../lobby_server.hpp"
+#include "../../database/db.hpp"
+
+void handleQueue(TCPConnection &conn, const nlohmann::json &d) {
+    Packet r;
+    r.type = PacketType::SERVER_RESPONSE;
+    r.data["kind"] = "QUEUE";
+
+    if (!d.contains("game_id") || !d.contains("player_id")) {
+        r.data["ok"]  = false;
+        r.data["msg"] = "Missing game_id/player_id.";
+        conn.sendPacket(r);
+        return;
+    }
+
+    int gid = d["game_id"];
+    int pid = d["player_id"];
+
+    auto *server = reinterpret_cast<LobbyServer*>(conn.owner);
+
+    if (server->isPlayerInRoom(pid)) {
+        r.data["ok"]  = false;
+        r.data["msg"] = "Already in a room.";
+        conn.sendPacket(r);
+        return;
+    }
+
+    int maxPlayers = -1;
+    for (auto &g : Database::instance().listActiveGames()) {
+        if (g.id == gid) {
+            maxPlayers = g.maxPlayers;
+            break;
+        }
+    }
+    if (maxPlayers < 0) {
+        r.data["ok"]  = false;
+        r.data["msg"] = "Game not found.";
+        conn.sendPacket(r);
+        return;
+    }
+
+    int pos = server->enqueuePlayer(gid, pid, maxPlayers);
+    if (pos < 0) {
+        r.data["ok"]  = false;
+        r.data["msg"] = "Already queued for another game.";
+        conn.sendPacket(r);
+        return;
+    }
+
+    // START_GAME is pushed once the matchmaker forms the room
+    r.data["ok"]          = true;
+    r.data["game_id"]     = gid;
+    r.data["position"]    = pos;
+    r.data["max_players"] = maxPlayers;
+    conn.sendPacket(r);
+}
+
+void handleLeaveQueue(TCPConnection &conn, const nlohmann::json &d) {
+    Packet r;
+    r.type = PacketType::SERVER_RESPONSE;
+    r.data["kind"] = "LEAVE_QUEUE";
+
+    if (!d.contains("player_id")) {
+        r.data["ok"]  = false;
+        r.data["msg"] = "Missing player_id.";
+        conn.sendPacket(r);
+        return;
+    }
+
+    auto *server = reinterpret_cast<LobbyServer*>(conn.owner);
+    bool ok = server->dequeuePlayer(d["player_id"].get<int>());
+
+    r.data["ok"] = ok;
+    if (!ok)
+        r.data["msg"] = "Not in a queue.";
+    conn.sendPacket(r);
+}
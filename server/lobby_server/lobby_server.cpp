@@ -2,18 +2,38 @@
 #include "../database/db.hpp"
 #include <iostream>
 #include <algorithm>
+#include <filesystem>
 #include <signal.h>     
 #include <unistd.h>     
+#include <sys/wait.h>
+#include <random>
+#include <cstdio>
 
 LobbyServer::LobbyServer(int port)
-    : m_port(port)
+    : m_port(port),
+      m_dispatcher(std::max(2u, std::thread::hardware_concurrency()), 4),
+      m_matchmaker(std::chrono::milliseconds(100), std::chrono::seconds(10)),
+      m_ratings([](int playerId) { return Database::instance().getPlayerName(playerId); })
 {
 }
 
+void LobbyServer::loadRatings() {
+    int n = 0;
+    for (auto &m : Database::instance().listMatchResults()) {
+        m_ratings.applyMatch(m.value("game_id", -1),
+                             m.value("players", std::vector<int>()),
+                             m.value("winner_id", -1));
+        n++;
+    }
+    std::cout << "[LobbyServer] Ratings rebuilt from " << n << " matches\n";
+}
+
 bool LobbyServer::start() {
 
     std::cout << "[LobbyServer] Listening on port " << m_port << "\n";
 
+    loadRatings();
+
     addHandler(PacketType::PLAYER_REGISTER,
         [this](TCPConnection &conn, const json &d) {
             handlePlayerRegister(conn, d);
@@ -27,12 +47,12 @@ bool LobbyServer::start() {
     addHandler(PacketType::PLAYER_LIST_GAMES,
         [this](TCPConnection &conn, const json &d) {
             handleListGames(conn, d);
-        });
+        }, ExecClass::Cpu);
 
     addHandler(PacketType::PLAYER_DOWNLOAD_GAME,
         [this](TCPConnection &conn, const json &d) {
             handleDownloadGame(conn, d);
-        });
+        }, ExecClass::Io);
 
     addHandler(PacketType::PLAYER_CREATE_ROOM,
         [this](TCPConnection &conn, const json &d) {
@@ -56,15 +76,46 @@ bool LobbyServer::start() {
     addHandler(PacketType::PLAYER_GET_REVIEWS,
         [this](TCPConnection &conn, const json &d) {
             handleGetReviews(conn, d);
+        }, ExecClass::Cpu);
+
+    addHandler(PacketType::PLAYER_GET_LEADERBOARD,
+        [this](TCPConnection &conn, const json &d) {
+            handleGetLeaderboard(conn, d);
+        }, ExecClass::Cpu);
+
+    addHandler(PacketType::PLAYER_QUEUE,
+        [this](TCPConnection &conn, const json &d) {
+            handleQueue(conn, d);
+        });
+
+    addHandler(PacketType::PLAYER_LEAVE_QUEUE,
+        [this](TCPConnection &conn, const json &d) {
+            handleLeaveQueue(conn, d);
         });
+
+    // From the game servers we launch
+    addHandler(PacketType::MATCH_STATUS,
+        [this](TCPConnection &conn, const json &d) {
+            handleMatchStatus(conn, d);
+        });
+
+    m_matchmaker.start([this](int gameId, const std::vector<int> &players) {
+        onQueueGroup(gameId, players);
+    });
+
     return m_server.start(m_port, [this](TCPConnection conn) {
-        conn.owner = this;     
-        std::thread(&LobbyServer::onClient, this, std::move(conn)).detach();
+        auto cptr = std::make_shared<TCPConnection>(std::move(conn));
+        cptr->owner = this;
+        {
+            std::lock_guard<std::mutex> lk(m_connsMutex);
+            m_conns[cptr->fd()] = cptr;
+        }
+        std::thread(&LobbyServer::onClient, this, cptr).detach();
     });
 }
 
-void LobbyServer::addHandler(PacketType type, HandlerFunc func) {
-    m_handlers[type] = std::move(func);
+void LobbyServer::addHandler(PacketType type, HandlerFunc func, ExecClass cls) {
+    m_dispatcher.add(type, cls, std::move(func));
 }
 
 // ---------------------------------------------------------
@@ -72,54 +123,123 @@ void LobbyServer::addHandler(PacketType type, HandlerFunc func) {
 // ---------------------------------------------------------
 
 int LobbyServer::createRoom(int gameId, int hostPlayerId, int maxPlayers) {
+    return createRoom(gameId, std::vector<int>{hostPlayerId}, maxPlayers);
+}
+
+// The room is complete before it is published: once it is in m_rooms other
+// threads may read it
+int LobbyServer::createRoom(int gameId, const std::vector<int> &players, int maxPlayers) {
     Room room;
-    room.roomId      = nextRoomId++;
     room.gameId      = gameId;
-    room.hostPlayerId= hostPlayerId;
+    room.hostPlayerId= players.front();
     room.maxPlayers  = maxPlayers;
-    room.players.push_back(hostPlayerId);
+    room.players     = players;
 
+    std::lock_guard<std::mutex> lk(m_roomsMutex);
+    room.roomId      = nextRoomId++;
     m_rooms[room.roomId] = room;
 
     std::cout << "[Lobby] Created room " << room.roomId
               << " for game " << gameId
-              << " host player " << hostPlayerId << "\n";
+              << " host player " << room.hostPlayerId << "\n";
 
     return room.roomId;
 }
 
-Room* LobbyServer::getRoom(int roomId) {
+bool LobbyServer::getRoom(int roomId, Room &out) {
+    std::lock_guard<std::mutex> lk(m_roomsMutex);
+    auto it = m_rooms.find(roomId);
+    if (it == m_rooms.end()) return false;
+    out = it->second;
+    return true;
+}
+
+bool LobbyServer::joinRoom(int roomId, int playerId, Room &out, std::string &err) {
+    std::lock_guard<std::mutex> lk(m_roomsMutex);
     auto it = m_rooms.find(roomId);
-    if (it == m_rooms.end()) return nullptr;
-    return &it->second;
+    if (it == m_rooms.end()) {
+        err = "Room not found.";
+        return false;
+    }
+    Room &room = it->second;
+    auto &v = room.players;
+    if (std::find(v.begin(), v.end(), playerId) == v.end()) {
+        if ((int)v.size() >= room.maxPlayers) {
+            err = "Room full.";
+            return false;
+        }
+        v.push_back(playerId);
+    }
+    out = room;
+    return true;
+}
+
+// The checks and the launch happen under m_roomsMutex, so two start
+// requests cannot both launch a server; the players are told from a copy
+bool LobbyServer::startRoomGame(int roomId, int playerId, std::string &err) {
+    Room started;
+    int port = 0;
+    {
+        std::lock_guard<std::mutex> lk(m_roomsMutex);
+        auto it = m_rooms.find(roomId);
+        if (it == m_rooms.end()) {
+            err = "Room not found.";
+            return false;
+        }
+        Room &room = it->second;
+        if (room.hostPlayerId != playerId) {
+            err = "Only host can start the game.";
+            return false;
+        }
+        if (room.players.size() < 2) {
+            err = "Need at least 2 players.";
+            return false;
+        }
+        if (room.serverRunning) {
+            err = "The game is already running.";
+            return false;
+        }
+        if (!launchGameServerUnlocked(room, port, err))
+            return false;
+        started = room;
+    }
+    broadcastStartGame(started, port);
+    return true;
 }
 
+bool LobbyServer::isPlayerInRoom(int playerId) {
+    std::lock_guard<std::mutex> lk(m_roomsMutex);
+    return findRoomByPlayerUnlocked(playerId) > 0;
+}
 
-void LobbyServer::onClient(TCPConnection conn) {
+
+void LobbyServer::onClient(std::shared_ptr<TCPConnection> conn) {
     std::cout << "[LobbyServer] New client connected\n";
 
-    int fd = conn.fd();
+    int fd = conn->fd();
     Packet packet;
 
-    while (conn.recvPacket(packet)) {
+    while (conn->recvPacket(packet)) {
         std::cout << "[LobbyServer] Received packet type="
                   << static_cast<int>(packet.type)
                   << " json=" << packet.data.dump()
                   << "\n";
 
-        auto it = m_handlers.find(packet.type);
-        if (it != m_handlers.end()) {
-            it->second(conn, packet.data);
-        } else {
+        if (!m_dispatcher.dispatch(conn, std::move(packet))) {
             Packet res;
             res.type = PacketType::ERROR_RESPONSE;
             res.data["msg"] = "Unknown lobby command!. ";
-            conn.sendPacket(res);
+            conn->sendPacket(res);
         }
     }
 
     std::cout << "[LobbyServer] Client disconnected\n";
 
+    {
+        std::lock_guard<std::mutex> lk(m_connsMutex);
+        m_conns.erase(fd);
+    }
+
     int playerId = getPlayerIdByFd(fd);
 
     unregisterPlayer(fd);
@@ -131,18 +251,36 @@ void LobbyServer::onClient(TCPConnection conn) {
 
 
 void LobbyServer::handlePlayerDisconnect(int playerId) {
-    Room* room = findRoomByPlayer(playerId);
-    if (!room) return;
-
-    auto &v = room->players;
-    v.erase(std::remove(v.begin(), v.end(), playerId), v.end());
+    dequeuePlayer(playerId);
+
+    std::lock_guard<std::mutex> lk(m_roomsMutex);
+    auto it = m_rooms.find(findRoomByPlayerUnlocked(playerId));
+    if (it == m_rooms.end()) return;
+    Room &room = it->second;
+
+    auto &v = room.players;
+
+    // The match goes on; the player may log back in and resume it. Only
+    // when everyone is gone is the server of no use
+    if (room.serverRunning) {
+        auto &away = room.away;
+        if (std::find(away.begin(), away.end(), playerId) == away.end())
+            away.push_back(playerId);
+        std::cout << "[Lobby] Player " << playerId << " dropped from running room "
+                  << room.roomId << ", seat kept\n";
+        if (away.size() < v.size()) return;
+    }
+    else {
+        v.erase(std::remove(v.begin(), v.end(), playerId), v.end());
+    }
 
-    if (v.empty()) {
-        if (room->serverRunning && room->serverPid > 0) {
-            kill(room->serverPid, SIGKILL);
-            std::cout << "[Lobby] Killed game server PID " << room->serverPid << "\n";
+    if (v.empty() || room.away.size() >= v.size()) {
+        if (room.serverRunning && room.serverPid > 0) {
+            kill(room.serverPid, SIGKILL);
+            std::cout << "[Lobby] Killed game server PID " << room.serverPid << "\n";
         }
-        removeRoom(room->roomId);
+        std::cout << "[Lobby] Removed room " << room.roomId << "\n";
+        m_rooms.erase(it);
         return;
     }
 
@@ -151,49 +289,362 @@ void LobbyServer::handlePlayerDisconnect(int playerId) {
 }
 
 
-Room* LobbyServer::findRoomByPlayer(int playerId) {
-    for (auto &kv : m_rooms) {
-        Room &room = kv.second;
-        for (int pid : room.players) {
-            if (pid == playerId)
-                return &kv.second;
-        }
-    }
-    return nullptr;
+bool LobbyServer::playerReturned(int playerId, json &resume) {
+    std::lock_guard<std::mutex> lk(m_roomsMutex);
+    auto it = m_rooms.find(findRoomByPlayerUnlocked(playerId));
+    if (it == m_rooms.end() || !it->second.serverRunning) return false;
+    Room &room = it->second;
+
+    auto &away = room.away;
+    away.erase(std::remove(away.begin(), away.end(), playerId), away.end());
+
+    resume["room_id"]     = room.roomId;
+    resume["game_id"]     = room.gameId;
+    resume["server_port"] = room.serverPort;
+    return true;
 }
 
-void LobbyServer::removeRoom(int roomId) {
-    m_rooms.erase(roomId);
-    std::cout << "[Lobby] Removed room " << roomId << "\n";
+
+int LobbyServer::findRoomByPlayerUnlocked(int playerId) const {
+    for (auto &kv : m_rooms) {
+        const auto &v = kv.second.players;
+        if (std::find(v.begin(), v.end(), playerId) != v.end())
+            return kv.first;
+    }
+    return -1;
 }
 
 bool LobbyServer::isPlayerOnline(int playerId) const {
+    std::lock_guard<std::mutex> lk(m_playersMutex);
     return m_playerToFd.find(playerId) != m_playerToFd.end();
 }
 
-void LobbyServer::registerPlayer(int playerId, int fd) {
-    m_playerToFd[playerId] = fd;
-    m_fdToPlayer[fd]       = playerId;
+bool LobbyServer::registerPlayer(int playerId, int fd) {
+    std::lock_guard<std::mutex> lk(m_playersMutex);
+    if (!m_playerToFd.emplace(playerId, fd).second) return false;
+    m_fdToPlayer[fd] = playerId;
+    return true;
 }
 
 int LobbyServer::getPlayerIdByFd(int fd) {
+    std::lock_guard<std::mutex> lk(m_playersMutex);
     auto it = m_fdToPlayer.find(fd);
     if (it == m_fdToPlayer.end()) return -1;
     return it->second;
 }
 
 void LobbyServer::unregisterPlayer(int fd) {
-    int pid = getPlayerIdByFd(fd);
-    if (pid > 0)
-        m_playerToFd.erase(pid);
-    m_fdToPlayer.erase(fd);
+    std::lock_guard<std::mutex> lk(m_playersMutex);
+    auto it = m_fdToPlayer.find(fd);
+    if (it == m_fdToPlayer.end()) return;
+    m_playerToFd.erase(it->second);
+    m_fdToPlayer.erase(it);
 }
-int LobbyServer::allocateGamePort() {
-    static int nextPort = 20100;  
 
+bool LobbyServer::sendToPlayer(int playerId, const Packet &p) {
+    int fd = -1;
+    {
+        std::lock_guard<std::mutex> lk(m_playersMutex);
+        auto it = m_playerToFd.find(playerId);
+        if (it != m_playerToFd.end()) fd = it->second;
+    }
+    if (fd <= 0) return false;
+    return sendByFd(fd, p);
+}
+int LobbyServer::allocateGamePort() {
+    std::lock_guard<std::mutex> lk(m_portsMutex);
+    if (!m_freePorts.empty()) {
+        int port = m_freePorts.back();
+        m_freePorts.pop_back();
+        return port;
+    }
+    return m_nextGamePort++;
+}
 
-    return nextPort++;
+void LobbyServer::releaseGamePort(int port) {
+    std::lock_guard<std::mutex> lk(m_portsMutex);
+    m_freePorts.push_back(port);
 }
 bool LobbyServer::sendByFd(int fd, const Packet &p) {
-    return m_server.sendRawPacket(fd, p);
+    std::shared_ptr<TCPConnection> conn;
+    {
+        std::lock_guard<std::mutex> lk(m_connsMutex);
+        auto it = m_conns.find(fd);
+        if (it != m_conns.end()) conn = it->second.lock();
+    }
+    if (!conn) return false;
+    return conn->sendPacket(p);
+}
+
+// ---------------------------------------------------------
+// Game server launch
+// ---------------------------------------------------------
+
+bool LobbyServer::launchGameServerUnlocked(Room &room, int &port, std::string &err) {
+    namespace fs = std::filesystem;
+
+    std::string base = Database::instance().getLatestVersionStoragePath(room.gameId);
+    if (base.empty()) {
+        err = "Game not found.";
+        return false;
+    }
+    if (base.back() != '/') base += '/';
+
+    std::string serverDir = base + "server/";
+    std::string serverExe;
+
+    std::cout << "serverDir: " << serverDir << "\n";
+    if (fs::exists(serverDir)) {
+        for (auto &entry : fs::directory_iterator(serverDir)) {
+            if (!entry.is_regular_file()) continue;
+
+            std::string name = entry.path().filename().string();
+            if (name == "game_server") {
+                serverExe = entry.path().string();
+                break;
+            }
+        }
+    }
+
+    if (serverExe.empty()) {
+        err = "No executable found in: " + serverDir;
+        return false;
+    }
+
+    port = allocateGamePort();
+
+    // Proves the server's MATCH_STATUS reports are from this launch
+    std::random_device rd;
+    auto newToken = [&rd] {
+        char t[17];
+        snprintf(t, sizeof(t), "%08x%08x", rd(), rd());
+        return std::string(t);
+    };
+    const std::string token = newToken();
+
+    std::unordered_map<int, std::string> seatTokens;
+    std::string seats;   // --seats account:token,...
+    for (int pid : room.players) {
+        seatTokens[pid] = newToken();
+        if (!seats.empty()) seats += ',';
+        seats += std::to_string(pid) + ":" + seatTokens[pid];
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl(serverExe.c_str(),
+            serverExe.c_str(),
+            "--port",
+            std::to_string(port).c_str(),
+            "--lobby-port",
+            std::to_string(m_port).c_str(),
+            "--room-id",
+            std::to_string(room.roomId).c_str(),
+            "--lobby-token",
+            token.c_str(),
+            "--seats",
+            seats.c_str(),
+            (char*)NULL);
+        std::cerr << "[Lobby] exec() failed for " << serverExe << "\n";
+        _exit(1);
+    }
+    if (pid < 0) {
+        err = "fork() failed.";
+        releaseGamePort(port);
+        return false;
+    }
+
+    room.serverPid = pid;
+    room.serverRunning = true;
+    room.serverPort = port;
+    room.serverToken = token;
+    room.seatTokens = std::move(seatTokens);
+    room.matchStarted = false;
+    room.lastTurn = 0;
+
+    std::thread(&LobbyServer::reapGameServer, this, room.roomId, pid, port).detach();
+
+    std::cout << "[Lobby] Game server PID=" << pid
+              << " on port " << port << "\n";
+    return true;
+}
+
+// The port is free again once the process is gone. A server that dies
+// without reporting a result leaves its room as if the match had ended.
+void LobbyServer::reapGameServer(int roomId, pid_t pid, int port) {
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    releaseGamePort(port);
+
+    std::lock_guard<std::mutex> lk(m_roomsMutex);
+    auto it = m_rooms.find(roomId);
+    if (it == m_rooms.end() || it->second.serverPid != pid) {
+        std::cout << "[Lobby] Game server PID " << pid << " exited, port "
+                  << port << " free\n";
+        return;
+    }
+    std::cout << "[Lobby] Game server PID " << pid << " of room " << roomId
+              << " exited without a result (status " << status << ")\n";
+    endMatchUnlocked(it->second);
+}
+
+// Players that dropped out during the match leave the room now; a room
+// nobody is left in goes away
+void LobbyServer::endMatchUnlocked(Room &room) {
+    room.serverRunning = false;
+    room.serverPid = -1;
+    room.serverPort = -1;
+    room.serverToken.clear();
+    room.seatTokens.clear();
+    room.matchStarted = false;
+
+    auto &v = room.players;
+    for (int pid : room.away)
+        v.erase(std::remove(v.begin(), v.end(), pid), v.end());
+    room.away.clear();
+
+    if (v.empty()) {
+        std::cout << "[Lobby] Removed room " << room.roomId << "\n";
+        m_rooms.erase(room.roomId);
+        return;
+    }
+    if (std::find(v.begin(), v.end(), room.hostPlayerId) == v.end())
+        room.hostPlayerId = v.front();
+}
+
+// The room is checked, copied and, for a result, ended in one go under
+// m_roomsMutex: the server exits right after reporting, so the reaper may
+// be about to end the same room. The database and ratings work on the copy.
+void LobbyServer::onMatchStatus(const json &d) {
+    const int roomId = d.value("room_id", 0);
+    const std::string event = d.value("event", "");
+    const std::string token = d.value("token", "");
+
+    int gameId;
+    std::vector<int> members;
+    {
+        std::lock_guard<std::mutex> lk(m_roomsMutex);
+        auto it = m_rooms.find(roomId);
+        if (it == m_rooms.end() || !it->second.serverRunning ||
+            it->second.serverToken.empty() || token != it->second.serverToken) {
+            std::cout << "[Lobby] Ignoring MATCH_STATUS for room " << roomId << "\n";
+            return;
+        }
+        Room &room = it->second;
+
+        if (event == "started") {
+            room.matchStarted = true;
+            std::cout << "[Lobby] Room " << roomId << " match started with "
+                      << d.value("seats", json::array()).size() << " seats\n";
+            return;
+        }
+        if (event == "health") {
+            room.lastTurn = d.value("turn", room.lastTurn);
+            return;
+        }
+        if (event != "result") return;
+
+        gameId  = room.gameId;
+        members = room.players;
+        endMatchUnlocked(room);   // may erase it
+    }
+
+    // The server mapped seats to accounts by the seat tokens we gave out;
+    // only members of the room count
+    std::vector<int> players;
+    int winner = d.value("result", std::string()) == "draw" ? -1 : 0;
+    const int winnerSeat = d.value("winner", -1);
+    if (d.contains("seats") && d["seats"].is_array()) {
+        for (auto &seat : d["seats"]) {
+            int lp = seat.value("lobby_player", 0);
+            if (lp <= 0 ||
+                std::find(members.begin(), members.end(), lp) == members.end() ||
+                std::find(players.begin(), players.end(), lp) != players.end())
+                continue;
+            players.push_back(lp);
+            if (seat.value("id", 0) == winnerSeat) winner = lp;
+        }
+    }
+
+    int matchId = Database::instance().addMatchResult(gameId, roomId, players,
+                                                      winner, d.value("turns", 0));
+    m_ratings.applyMatch(gameId, players, winner);
+    std::cout << "[Lobby] Room " << roomId << " match " << matchId << " over: "
+              << d.value("result", std::string("?")) << ", winner " << winner << "\n";
+}
+
+void LobbyServer::broadcastStartGame(const Room &room, int port) {
+    Packet b;
+    b.type = PacketType::SERVER_RESPONSE;
+    b.data["kind"] = "START_GAME";
+    b.data["ok"] = true;
+    b.data["game_id"] = room.gameId;
+    b.data["room_id"] = room.roomId;
+    b.data["server_port"] = port;
+
+    for (int pidPlayer : room.players) {
+        Packet b2 = b;
+        b2.data["is_host"] = (pidPlayer == room.hostPlayerId)? "1":"0";
+        auto seat = room.seatTokens.find(pidPlayer);
+        if (seat != room.seatTokens.end()) b2.data["seat_token"] = seat->second;
+        sendToPlayer(pidPlayer, b2);
+    }
+}
+
+// ---------------------------------------------------------
+// Matchmaking
+// ---------------------------------------------------------
+
+int LobbyServer::enqueuePlayer(int gameId, int playerId, int maxPlayers) {
+    return m_matchmaker.enqueue(gameId, playerId, maxPlayers);
+}
+
+bool LobbyServer::dequeuePlayer(int playerId) {
+    return m_matchmaker.dequeue(playerId);
+}
+
+void LobbyServer::onQueueGroup(int gameId, const std::vector<int> &players) {
+    int maxPlayers = (int)players.size();
+    for (auto &g : Database::instance().listActiveGames()) {
+        if (g.id == gameId) {
+            maxPlayers = g.maxPlayers;
+            break;
+        }
+    }
+
+    int rid = createRoom(gameId, players, maxPlayers);
+
+    // Launched under the lock like startRoomGame; a room whose launch
+    // fails goes away in the same step
+    Room started;
+    int port = 0;
+    std::string err;
+    bool ok = false;
+    {
+        std::lock_guard<std::mutex> lk(m_roomsMutex);
+        auto it = m_rooms.find(rid);
+        if (it == m_rooms.end()) {
+            err = "Room closed.";    // everyone in it dropped already
+        } else if (launchGameServerUnlocked(it->second, port, err)) {
+            started = it->second;
+            ok = true;
+        } else {
+            m_rooms.erase(it);
+        }
+    }
+
+    if (!ok) {
+        std::cerr << "[Matchmaker] " << err << "\n";
+
+        Packet f;
+        f.type = PacketType::SERVER_RESPONSE;
+        f.data["kind"] = "START_GAME";
+        f.data["ok"]   = false;
+        f.data["msg"]  = "Matchmaking failed: " + err;
+        for (int pid : players)
+            sendToPlayer(pid, f);
+        return;
+    }
+
+    broadcastStartGame(started, port);
 }
@@ -5,10 +5,16 @@
 #include "../shared/json.hpp"
 #include "../shared/tcp.hpp"
 #include "../shared/protocol.hpp"
+#include "../shared/dispatcher.hpp"
+#include "matchmaker.hpp"
+#include "ratings.hpp"
 
 #include <unordered_map>
 #include <vector>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
 
 using json = nlohmann::json;
 
@@ -22,6 +28,17 @@ struct Room {
     // Game server process tracking
     pid_t serverPid = -1;
     bool  serverRunning = false;
+    int   serverPort = -1;
+    std::string serverToken;    // carried by the server's MATCH_STATUS reports
+    // Player -> seat token, sent to the player with START_GAME and to the
+    // server at launch; how the server knows which account is which
+    std::unordered_map<int, std::string> seatTokens;
+    bool  matchStarted = false;
+    int   lastTurn = 0;         // from the latest health report
+
+    // Players whose lobby connection dropped mid-match; they keep their
+    // seat so they can log in again and resume
+    std::vector<int> away;
 };
 
 class LobbyServer {
@@ -31,41 +48,93 @@ public:
     bool start();
 
     // main per-connection loop
-    void onClient(TCPConnection conn);
+    void onClient(std::shared_ptr<TCPConnection> conn);
 
-    using HandlerFunc = std::function<void(TCPConnection&, const json&)>;
-    void addHandler(PacketType type, HandlerFunc func);
+    using HandlerFunc = PacketDispatcher::HandlerFunc;
+    void addHandler(PacketType type, HandlerFunc func,
+                    ExecClass cls = ExecClass::Inline);
 
-    // Rooms
+    // Rooms. They are only touched under m_roomsMutex; callers get copies.
     int  createRoom(int gameId, int hostPlayerId, int maxPlayers);
-    Room* getRoom(int roomId);
+    // A room already holding its players; players[0] hosts
+    int  createRoom(int gameId, const std::vector<int> &players, int maxPlayers);
+    bool getRoom(int roomId, Room &out);
+    // Adds the player (once) and fills out with the room; err if it cannot
+    bool joinRoom(int roomId, int playerId, Room &out, std::string &err);
+    // Host only: launches the room's game server and pushes START_GAME
+    bool startRoomGame(int roomId, int playerId, std::string &err);
+    bool isPlayerInRoom(int playerId);
 
     // Disconnect handling
     void handlePlayerDisconnect(int playerId);
-    Room* findRoomByPlayer(int playerId);
-    void  removeRoom(int roomId);
+    // Back from a drop: the running match to resume, if any
+    bool playerReturned(int playerId, json &resume);
+
+    // A MATCH_STATUS report from one of our game servers. A "result" is
+    // recorded, rated and frees the room for another match.
+    void onMatchStatus(const json &d);
+
+    // Rebuilt from the stored match history at start, then kept up to
+    // date one result at a time
+    Ratings &ratings() { return m_ratings; }
+
+    // Matchmaking queue
+    int  enqueuePlayer(int gameId, int playerId, int maxPlayers);
+    bool dequeuePlayer(int playerId);
 
     bool isPlayerOnline(int playerId) const;
-    void registerPlayer(int playerId, int fd);
-    // Player <-> fd mapping
+    // Player <-> fd mapping. False if the player is already logged in
+    // on another connection.
+    bool registerPlayer(int playerId, int fd);
     int  getPlayerIdByFd(int fd);
     void unregisterPlayer(int fd);
+    // Pushes to a logged-in player's connection, if any
+    bool sendToPlayer(int playerId, const Packet &p);
 
-    // These are used by handlers 
-    std::unordered_map<int,int> m_fdToPlayer;   
-    std::unordered_map<int,int> m_playerToFd;   
-
-    // rooms
-    std::unordered_map<int, Room> m_rooms;
     int allocateGamePort();
+    void releaseGamePort(int port);
     bool sendByFd(int fd, const Packet &p);
 private:
     int m_port;
     TCPServer m_server;
 
-    std::unordered_map<PacketType, HandlerFunc> m_handlers;
+    PacketDispatcher m_dispatcher;
+
+    // Live connections by fd, so pushes share the connection's send lock
+    std::unordered_map<int, std::weak_ptr<TCPConnection>> m_conns;
+    std::mutex m_connsMutex;
+
+    // Written by the connection threads on login and logout, read by
+    // whichever thread pushes to a player (handlers, the matchmaker)
+    std::unordered_map<int,int> m_fdToPlayer;
+    std::unordered_map<int,int> m_playerToFd;
+    mutable std::mutex m_playersMutex;
 
+    std::unordered_map<int, Room> m_rooms;
+    std::mutex m_roomsMutex;
     int nextRoomId = 1;
+
+    // Room id of the room the player is in, or -1; m_roomsMutex held
+    int findRoomByPlayerUnlocked(int playerId) const;
+
+    // Game server process for a room, m_roomsMutex held; fills port or err
+    bool launchGameServerUnlocked(Room &room, int &port, std::string &err);
+    void broadcastStartGame(const Room &room, int port);
+
+    // Ports of exited game servers are handed out again first
+    std::mutex m_portsMutex;
+    std::vector<int> m_freePorts;
+    int m_nextGamePort = 20100;
+
+    // One thread per launched server, waiting for it to exit
+    void reapGameServer(int roomId, pid_t pid, int port);
+    void endMatchUnlocked(Room &room);
+
+    Matchmaker m_matchmaker;
+    void onQueueGroup(int gameId, const std::vector<int> &players);
+
+    Ratings m_ratings;
+    void loadRatings();
 };
 
 
@@ -79,5 +148,9 @@ void handleJoinRoom(TCPConnection&, const nlohmann::json&);
 void handleStartGame(TCPConnection&, const nlohmann::json&);
 void handleSubmitReview(TCPConnection &conn, const nlohmann::json &d);
 void handleGetReviews(TCPConnection &conn, const nlohmann::json &d);
+void handleQueue(TCPConnection &conn, const nlohmann::json &d);
+void handleLeaveQueue(TCPConnection &conn, const nlohmann::json &d);
+void handleMatchStatus(TCPConnection &conn, const nlohmann::json &d);
+void handleGetLeaderboard(TCPConnection &conn, const nlohmann::json &d);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,154 @@
+#include "matchmaker.hpp"
+#include <algorithm>
+#include <iostream>
+
+Matchmaker::Matchmaker(std::chrono::milliseconds interval,
+                       std::chrono::milliseconds fillTimeout)
+    : m_interval(interval),
+      m_fillTimeout(fillTimeout)
+{
+}
+
+Matchmaker::~Matchmaker() {
+    stop();
+}
+
+void Matchmaker::start(GroupFunc onGroup) {
+    if (m_running) return;
+    m_onGroup = std::move(onGroup);
+    m_running = true;
+    m_thread = std::thread(&Matchmaker::loop, this);
+}
+
+void Matchmaker::stop() {
+    if (!m_running) return;
+    m_running = false;
+    m_cv.notify_all();
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+int Matchmaker::enqueue(int gameId, int playerId, int maxPlayers) {
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    Queue &q = m_queues[gameId];
+    q.maxPlayers = std::max(maxPlayers, kMinPlayers);
+
+    auto it = m_players.find(playerId);
+    if (it != m_players.end()) {
+        // Re-queueing for the same game keeps the original place in line
+        if (it->second.gameId != gameId) return -1;
+        return positionOf(q, it->second.serial);
+    }
+
+    unsigned serial = m_nextSerial++;
+    q.waiting.push_back(Ticket{playerId, serial, Clock::now()});
+    q.live++;
+    m_players[playerId] = Placement{gameId, serial};
+
+    return q.live;
+}
+
+bool Matchmaker::dequeue(int playerId) {
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    auto it = m_players.find(playerId);
+    if (it == m_players.end()) return false;
+
+    // The ticket stays in the deque and is skipped when drained
+    auto qit = m_queues.find(it->second.gameId);
+    if (qit != m_queues.end()) qit->second.live--;
+    m_players.erase(it);
+    return true;
+}
+
+// Live tickets up to and including this one; cancelled ones still sit in
+// the deque and are skipped
+int Matchmaker::positionOf(const Queue &q, unsigned serial) const {
+    int pos = 0;
+    for (const Ticket &t : q.waiting) {
+        auto it = m_players.find(t.playerId);
+        if (it == m_players.end() || it->second.serial != t.serial)
+            continue;
+        pos++;
+        if (t.serial == serial) break;
+    }
+    return pos;
+}
+
+bool Matchmaker::popLive(Queue &q, int &playerId) {
+    while (!q.waiting.empty()) {
+        Ticket t = q.waiting.front();
+        q.waiting.pop_front();
+
+        auto it = m_players.find(t.playerId);
+        if (it == m_players.end() || it->second.serial != t.serial)
+            continue;   // cancelled
+
+        m_players.erase(it);
+        q.live--;
+        playerId = t.playerId;
+        return true;
+    }
+    return false;
+}
+
+void Matchmaker::collectGroups(std::vector<std::pair<int, std::vector<int>>> &out) {
+    std::lock_guard<std::mutex> lk(m_mutex);
+    auto now = Clock::now();
+
+    for (auto &kv : m_queues) {
+        Queue &q = kv.second;
+
+        while (q.live > 0) {
+            // Drop cancelled tickets at the head so `since` is a live one
+            while (!q.waiting.empty()) {
+                const Ticket &t = q.waiting.front();
+                auto it = m_players.find(t.playerId);
+                if (it != m_players.end() && it->second.serial == t.serial)
+                    break;
+                q.waiting.pop_front();
+            }
+
+            int take = 0;
+            if (q.live >= q.maxPlayers) {
+                take = q.maxPlayers;
+            } else if (q.live >= kMinPlayers &&
+                       now - q.waiting.front().since >= m_fillTimeout) {
+                // Nobody else showed up in time: start with who is here
+                take = q.live;
+            } else {
+                break;
+            }
+
+            std::vector<int> group;
+            group.reserve(take);
+            int pid;
+            while ((int)group.size() < take && popLive(q, pid))
+                group.push_back(pid);
+
+            out.emplace_back(kv.first, std::move(group));
+        }
+    }
+}
+
+void Matchmaker::loop() {
+    std::vector<std::pair<int, std::vector<int>>> groups;
+
+    while (m_running) {
+        {
+            std::unique_lock<std::mutex> lk(m_mutex);
+            m_cv.wait_for(lk, m_interval, [this] { return !m_running; });
+        }
+        if (!m_running) break;
+
+        groups.clear();
+        collectGroups(groups);
+
+        for (auto &g : groups) {
+            std::cout << "[Matchmaker] Formed group of " << g.second.size()
+                      << " for game " << g.first << "\n";
+            m_onGroup(g.first, g.second);
+        }
+    }
+}
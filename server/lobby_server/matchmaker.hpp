@@ -0,0 +1,76 @@
+#ifndef MATCHMAKER_HPP
+#define MATCHMAKER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Per-game player queues, drained in batches by one background thread.
+// Handlers only push/pop tickets; rooms are formed on the matchmaker thread
+// every `interval`, so a burst of queue requests costs one pass per batch.
+class Matchmaker {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Called once per formed group, outside the queue lock.
+    // players[0] is the host.
+    using GroupFunc = std::function<void(int gameId, const std::vector<int> &players)>;
+
+    static constexpr int kMinPlayers = 2;
+
+    Matchmaker(std::chrono::milliseconds interval,
+               std::chrono::milliseconds fillTimeout);
+    ~Matchmaker();
+
+    void start(GroupFunc onGroup);
+    void stop();
+
+    // Returns the 1-based queue position, or -1 if the player is already
+    // waiting in another game's queue.
+    int  enqueue(int gameId, int playerId, int maxPlayers);
+    bool dequeue(int playerId);
+
+private:
+    struct Ticket {
+        int               playerId;
+        unsigned          serial;
+        Clock::time_point since;
+    };
+
+    struct Queue {
+        int                maxPlayers = kMinPlayers;
+        int                live = 0;    // tickets not cancelled
+        std::deque<Ticket> waiting;
+    };
+
+    struct Placement {
+        int      gameId;
+        unsigned serial;
+    };
+
+    void loop();
+    void collectGroups(std::vector<std::pair<int, std::vector<int>>> &out);
+    bool popLive(Queue &q, int &playerId);
+    int  positionOf(const Queue &q, unsigned serial) const;
+
+    std::chrono::milliseconds m_interval;
+    std::chrono::milliseconds m_fillTimeout;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::unordered_map<int, Queue>     m_queues;   // gameId -> queue
+    std::unordered_map<int, Placement> m_players;  // playerId -> live ticket
+    unsigned m_nextSerial = 1;
+
+    GroupFunc m_onGroup;
+    std::atomic<bool> m_running{false};
+    std::thread m_thread;
+};
+
+#endif
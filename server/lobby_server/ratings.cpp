@@ -0,0 +1,114 @@
+#include "ratings.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+Ratings::Player &Ratings::playerUnlocked(Board &b, int playerId) {
+    auto it = b.players.find(playerId);
+    if (it != b.players.end()) return it->second;
+
+    Player &p = b.players[playerId];
+    if (m_names) p.name = m_names(playerId);
+    b.order.insert({-p.rating, playerId});
+    return p;
+}
+
+Ratings::Entry Ratings::entryUnlocked(const Board &b, Tree::const_iterator it, int rank) const {
+    const Player &p = b.players.at(it->second);
+    Entry e;
+    e.playerId = it->second;
+    e.rank     = rank;
+    e.rating   = p.rating;
+    e.games    = p.games;
+    e.wins     = p.wins;
+    e.name     = p.name;
+    return e;
+}
+
+void Ratings::applyMatch(int gameId, const std::vector<int> &players, int winnerId) {
+    if (players.size() < 2) return;
+    const double k = kK / (players.size() - 1);
+
+    std::lock_guard<std::mutex> lk(m_mutex);
+    Board &b = m_boards[gameId];
+
+    // Every pairing is scored on the ratings from before the match
+    std::vector<double> before, delta(players.size(), 0.0);
+    for (int id : players)
+        before.push_back(playerUnlocked(b, id).rating);
+
+    for (size_t i = 0; i < players.size(); i++) {
+        for (size_t j = i + 1; j < players.size(); j++) {
+            double score;   // i's result against j
+            if (winnerId < 0)                  score = 0.5;
+            else if (players[i] == winnerId)   score = 1.0;
+            else if (players[j] == winnerId)   score = 0.0;
+            else                               continue;
+
+            double expected = 1.0 / (1.0 + std::pow(10.0, (before[j] - before[i]) / 400.0));
+            delta[i] += k * (score - expected);
+            delta[j] -= k * (score - expected);
+        }
+    }
+
+    for (size_t i = 0; i < players.size(); i++) {
+        Player &p = b.players[players[i]];
+        b.order.erase({-p.rating, players[i]});
+        p.rating += delta[i];
+        p.games++;
+        if (players[i] == winnerId) p.wins++;
+        b.order.insert({-p.rating, players[i]});
+    }
+}
+
+std::vector<Ratings::Entry> Ratings::top(int gameId, int offset, int n) {
+    std::vector<Entry> out;
+    std::lock_guard<std::mutex> lk(m_mutex);
+    auto bit = m_boards.find(gameId);
+    if (bit == m_boards.end() || n <= 0) return out;
+    const Board &b = bit->second;
+
+    offset = std::max(0, offset);
+    auto it = b.order.find_by_order(offset);
+    for (int i = 0; i < n && it != b.order.end(); i++, ++it)
+        out.push_back(entryUnlocked(b, it, offset + i + 1));
+    return out;
+}
+
+std::vector<Ratings::Entry> Ratings::around(int gameId, int playerId, int radius) {
+    std::vector<Entry> out;
+    std::lock_guard<std::mutex> lk(m_mutex);
+    auto bit = m_boards.find(gameId);
+    if (bit == m_boards.end()) return out;
+    const Board &b = bit->second;
+
+    auto pit = b.players.find(playerId);
+    if (pit == b.players.end()) return out;
+
+    int rank = (int)b.order.order_of_key({-pit->second.rating, playerId});
+    int first = std::max(0, rank - std::max(0, radius));
+    auto it = b.order.find_by_order(first);
+    for (int r = first; r <= rank + radius && it != b.order.end(); r++, ++it)
+        out.push_back(entryUnlocked(b, it, r + 1));
+    return out;
+}
+
+bool Ratings::find(int gameId, int playerId, Entry &out) {
+    std::lock_guard<std::mutex> lk(m_mutex);
+    auto bit = m_boards.find(gameId);
+    if (bit == m_boards.end()) return false;
+    const Board &b = bit->second;
+
+    auto pit = b.players.find(playerId);
+    if (pit == b.players.end()) return false;
+
+    Tree::const_iterator it = b.order.find({-pit->second.rating, playerId});
+    out = entryUnlocked(b, it, (int)b.order.order_of_key(*it) + 1);
+    return true;
+}
+
+int Ratings::size(int gameId) {
+    std::lock_guard<std::mutex> lk(m_mutex);
+    auto bit = m_boards.find(gameId);
+    return bit == m_boards.end() ? 0 : (int)bit->second.order.size();
+}
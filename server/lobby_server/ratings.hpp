@@ -0,0 +1,82 @@
+#ifndef RATINGS_HPP
+#define RATINGS_HPP
+
+#include <ext/pb_ds/assoc_container.hpp>
+#include <ext/pb_ds/tree_policy.hpp>
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Per-game Elo ratings and leaderboards, updated one match at a time.
+//
+// Each game keeps its players in an order-statistic tree keyed by
+// (-rating, player id), so a rating change is an erase and an insert, a
+// player's rank is order_of_key() and the k-th place is find_by_order(),
+// all O(log n). Top-N and "around me" pages never scan the board.
+//
+// A match with a winner counts as a win for the winner against every other
+// player; the others are not compared with each other. A draw is a draw
+// between every pair. Each pairing moves ratings by up to
+// kK / (players - 1), so a match is worth about one game against one
+// opponent whatever its size.
+class Ratings {
+public:
+    static constexpr double kInitial = 1500.0;
+    static constexpr double kK = 32.0;
+
+    struct Entry {
+        int         playerId = 0;
+        int         rank = 0;        // 1-based
+        double      rating = kInitial;
+        int         games = 0;
+        int         wins = 0;
+        std::string name;
+    };
+
+    // Looks a player's name up the first time they are rated
+    using NameFunc = std::function<std::string(int playerId)>;
+    explicit Ratings(NameFunc names) : m_names(std::move(names)) {}
+
+    // winnerId -1 = draw, 0 = none of them won (nothing to compare, but
+    // the game counts). Players not yet rated start at kInitial.
+    void applyMatch(int gameId, const std::vector<int> &players, int winnerId);
+
+    // Best `n` players from `offset` on (0-based)
+    std::vector<Entry> top(int gameId, int offset, int n);
+    // Up to `radius` players either side of `playerId`, them included;
+    // empty if they have no rating in this game
+    std::vector<Entry> around(int gameId, int playerId, int radius);
+    bool find(int gameId, int playerId, Entry &out);
+    int  size(int gameId);
+
+private:
+    using Key = std::pair<double, int>;   // (-rating, player id)
+    using Tree = __gnu_pbds::tree<Key, __gnu_pbds::null_type, std::less<Key>,
+                                  __gnu_pbds::rb_tree_tag,
+                                  __gnu_pbds::tree_order_statistics_node_update>;
+
+    struct Player {
+        double      rating = kInitial;
+        int         games = 0;
+        int         wins = 0;
+        std::string name;
+    };
+
+    struct Board {
+        Tree order;
+        std::unordered_map<int, Player> players;
+    };
+
+    Player &playerUnlocked(Board &b, int playerId);
+    Entry entryUnlocked(const Board &b, Tree::const_iterator it, int rank) const;
+
+    NameFunc m_names;
+    std::mutex m_mutex;
+    std::unordered_map<int, Board> m_boards;   // by game id
+};
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef DISPATCHER_HPP
+#define DISPATCHER_HPP
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <memory>
+
+#include "json.hpp"
+#include "packet.hpp"
+#include "protocol.hpp"
+#include "tcp.hpp"
+#include "thread_pool.hpp"
+
+// Where a handler runs.
+//   Inline - on the connection's network thread (cheap, order-sensitive)
+//   Cpu    - hashing / encoding work
+//   Io     - disk reads/writes, archive extraction
+enum class ExecClass {
+    Inline,
+    Cpu,
+    Io
+};
+
+// Packet handlers indexed directly by PacketType value. Offloaded handlers
+// keep the connection alive through the shared_ptr, so the network thread
+// can go back to recv() while they run. Replies sent on the same
+// connection from inside a handler echo the request's req_id, which lets
+// offloaded requests complete out of order.
+class PacketDispatcher {
+public:
+    using HandlerFunc = std::function<void(TCPConnection&, const nlohmann::json&)>;
+
+    static constexpr std::size_t kTableSize = 512;
+    static_assert(static_cast<std::size_t>(PacketType::ERROR_RESPONSE) < kTableSize,
+                  "PacketType value outside the dispatch table");
+
+    PacketDispatcher(std::size_t cpuThreads, std::size_t ioThreads)
+        : m_cpu(cpuThreads), m_io(ioThreads) {}
+
+    void add(PacketType type, ExecClass cls, HandlerFunc fn) {
+        std::size_t idx = static_cast<std::size_t>(type);
+        if (idx >= kTableSize) {
+            std::cerr << "[Dispatcher] PacketType " << idx << " out of range\n";
+            return;
+        }
+        m_table[idx].fn  = std::move(fn);
+        m_table[idx].cls = cls;
+    }
+
+    // Returns false when no handler is registered for the packet type.
+    bool dispatch(const std::shared_ptr<TCPConnection> &conn, Packet &&p) {
+        std::size_t idx = static_cast<std::size_t>(p.type);
+        if (idx >= kTableSize || !m_table[idx].fn)
+            return false;
+
+        const Slot &slot = m_table[idx];
+        uint32_t reqId = p.reqId;
+        if (slot.cls == ExecClass::Inline) {
+            ReplyScope scope(conn.get(), reqId);
+            slot.fn(*conn, p.data);
+            return true;
+        }
+
+        ThreadPool &pool = (slot.cls == ExecClass::Cpu) ? m_cpu : m_io;
+        pool.submit([&slot, conn, reqId, data = std::move(p.data)]() {
+            ReplyScope scope(conn.get(), reqId);
+            slot.fn(*conn, data);
+        });
+        return true;
+    }
+
+private:
+    struct Slot {
+        HandlerFunc fn;
+        ExecClass   cls = ExecClass::Inline;
+    };
+
+    std::array<Slot, kTableSize> m_table;
+    ThreadPool m_cpu;
+    ThreadPool m_io;
+};
+
+#endif
@@ -5,14 +5,23 @@
 #include "protocol.hpp"
 #include <string>
 #include <iostream>
+#include <cstdint>
 
 struct Packet {
     PacketType type;
     nlohmann::json data;
 
-    std::string serialize() const {
+    // Optional correlation id: a request carrying one gets it echoed in
+    // its reply, so several requests can be outstanding at once.
+    // 0 = none (pushes, or peers that do not pipeline).
+    uint32_t reqId = 0;
+
+    // replyTo is used when the packet has no reqId of its own
+    std::string serialize(uint32_t replyTo = 0) const {
         nlohmann::json j;
         j["type"] = (int)type;
+        uint32_t id = reqId ? reqId : replyTo;
+        if (id) j["req_id"] = id;
         j["data"] = data;
         return j.dump() + "\n";
     }
@@ -23,6 +32,7 @@ struct Packet {
         Packet p;
         p.type = (PacketType)j["type"].get<int>();
         p.data = j["data"];
+        p.reqId = j.value("req_id", 0u);
         return p;
     }
 };